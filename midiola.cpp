@@ -13,32 +13,200 @@
  *
  * ******************************************************************
 
-    This application acts as a JACK client, providing a single MIDI input port.
-    4 modes of operation are supported: 7/14-bit, CC/NRPN.
+    This application acts as a JACK client, providing one or more MIDI input
+ ports. Each port has its own mode, MIDI channel mask and universe range.
+    6 modes of operation are supported: 7/14/16-bit, CC/NRPN.
     7-bit modes half data resolution. 14-bit modes allow full 8-bit resolution.
     14-bit modes send DMX value when LSB recieved. LSB is single bit set by CC
- value > 63. NRPN supports absolute and relative control. Maximum 32 consecutive
- DMX512 universes supported but may start at any universe.
+ value > 63. 16-bit modes scale the full 14-bit MIDI value to a pair of
+ coarse/fine DMX slots, sent together when LSB received. NRPN supports absolute and relative control. Maximum 512
+ consecutive DMX512 universes supported but may start at any universe.
+    MIDI is decoded in the JACK process thread which queues slot changes to the
+ main (output) thread. Absolute CCs received more than once in a period are
+ coalesced, so only the last value of each is decoded. The output thread
+ applies changes to a shared universe arena and sends changed universes to OLA
+ at the refresh rate.
+    Each port writes to its own layer of the arena. Layers are merged per slot,
+ highest-takes-precedence (HTP) for intensity slots and latest-takes-precedence
+ (LTP) for all other slots.
+    Changes may fade over time. Fades are interpolated by the output thread
+ each refresh period.
+    A group maps one MIDI CC to many slots across universes. The output thread
+ expands each group change to its members from a precomputed list.
+    Effects (LFOs and chases) are rendered over the members of a group by the
+ output thread each refresh period into their own merge layer, started and
+ stopped by MIDI note or CC.
+    A cue stack, loaded from a text file, is compiled into lists of the slots
+ each cue changes (and the values to restore on BACK), so GO and BACK only
+ touch changed slots. Cues are triggered by MIDI note and program change.
+    Scenes (snapshots of all universes) are held in a bank file mapped into
+ memory. Program change recalls a scene into the port's layer with one copy
+ per universe.
+    Changes may be aligned with audio: each is stamped with the time of its
+ MIDI event plus audio playback latency, less fixture latency, and is held
+ in the queue until the refresh period nearest that time.
+    MIDI clock is tracked by the JACK process thread, which filters clock
+ jitter to estimate tempo and publishes clock position to the output thread,
+ so effects with a period in beats lock to an external sequencer.
+    A recorded show file may be played back locked to MIDI Time Code or JACK
+ transport, whose position is read in the JACK process thread. The
+ file is mapped into memory and frames are decoded from the nearest keyframe,
+ found through the file's seek index, into the show layer.
+    Output may be recorded to a show file. Each refresh period the output
+ thread copies the output frames to a queue. A recorder thread encodes them
+ as keyframes or deltas and writes them with a seek index. While JACK is
+ freewheeling (offline bounce), the output thread is not paced by the clock
+ but renders a frame for each refresh period of audio processed, with the
+ JACK process thread waiting for each frame.
+    DMX received from OLA may be fed back to MIDI, e.g. to motorised faders.
+ An OLA input thread compares each received universe with the last, 16 slots
+ at a time, and queues changed slots to the JACK process thread, which sends
+ the MIDI messages that would set each slot, at a limited rate.
+    A SysEx request is answered with a dump of the output levels of a range of
+ universes, run length encoded and packed into 7-bit SysEx messages by the
+ JACK process thread, as many messages each period as fit its output buffer.
+    Intensity slots are scaled by a grand master and submasters, controlled by
+ MIDI CC, before response curves are applied.
+    Response curves (gamma, S-curve, etc.) are applied to each slot as its
+ universe is sent, so the arena holds raw values and curves may be reloaded
+ (SIGHUP) without resending MIDI.
+    Universes may be rendered in parallel by a pool of render threads. Each
+ thread takes a contiguous share of the changed universes and steals from
+ other threads' shares when its own is done. Universes are sent to OLA by the
+ output thread after all are rendered.
  */
 
-#define VERSION "0.1.10"
-#define MAX_MIDI_UNIVERSE 32 // Defines quantity of universe data buffers
+#define VERSION "0.2.0"
+#define MAX_UNIVERSE 512      // Quantity of universe frames in the arena
+#define MAX_PORTS 16          // Maximum quantity of MIDI input ports
+#define DMX_SLOTS 512         // Quantity of slots in a DMX512 universe
+#define EVENT_QUEUE_SIZE 8192 // Quantity of queued slot changes (power of 2)
+#define DEFAULT_REFRESH 44    // Default output refresh rate (Hz)
+#define EFFECT_SOURCE MAX_PORTS // Merge source (layer) of effects
+#define CUE_SOURCE (MAX_PORTS + 1) // Merge source (layer) of cue stack
+#define SHOW_SOURCE (MAX_PORTS + 2) // Merge source (layer) of show playback
+#define MAX_SOURCES (MAX_PORTS + 3) // Quantity of merge sources (layers)
+#define MAX_RANGES 256        // Maximum quantity of configured slot ranges
+#define MAX_CURVES 16         // Maximum quantity of response curves
+#define MAX_MASTERS 16        // Quantity of masters (0 is grand master)
+#define MAX_GROUPS 64         // Quantity of slot groups
+#define MAX_GROUP_MEMBERS 16384 // Maximum quantity of slots in all groups
+#define MAX_EFFECTS 32        // Quantity of effects
+#define MAX_THREADS 16        // Maximum quantity of render threads
+#define DEFAULT_SCENES 128    // Quantity of scenes in a new scene bank
+#define MAX_SCENES 16384      // Maximum quantity of scenes (128 banks)
+#define SHOW_READAHEAD (4 << 20) // Bytes of show file to read ahead of playback
+#define RECORD_QUEUE 64       // Quantity of frames queued for recorder (power of 2)
+#define KEYFRAME_INTERVAL 5   // Seconds between recorded keyframes
+#define FEEDBACK_QUEUE_SIZE 16384 // Quantity of queued feedback slots (power of 2)
+#define MAX_FEEDBACK_MESSAGES 4 // Most MIDI messages that feed back one slot
+#define MIDI_EVENT_OVERHEAD 16  // Most JACK MIDI buffer bytes used per event
+#define DUMP_CHUNK_SLOTS 128  // Quantity of slots in each SysEx dump message
+#define DUMP_CHUNK_BYTES 160  // Maximum size of SysEx dump message
+#define SYSEX_ID 0x7d         // SysEx manufacturer ID (non-commercial)
+#define ENCODER_SLOW_RATE 10  // Encoder messages per second not accelerated
+#define ENCODER_MAX_ACCEL 32  // Maximum encoder step multiplier
+#define COALESCE_EVENTS 1024  // Quantity of MIDI events per period coalesced
 
+#include <atomic>          // provides lock-free queue indicies
 #include <getopt.h>        // provides command line parseing
+#include <math.h>          // provides pow
+#include <pthread.h>       // provides render thread pool
 #include <jack/jack.h>     // provides JACK interface
 #include <jack/midiport.h> // provides JACK MIDI interface
+#include <jack/transport.h> // provides JACK transport position
+#include <ola/Callback.h>
 #include <ola/DmxBuffer.h>
+#include <ola/client/ClientWrapper.h> // provides DMX input
 #include <ola/client/StreamingClient.h>
+#include <fcntl.h>    // provides open
+#include <sys/mman.h> // provides mmap
+#include <sys/stat.h> // provides fstat
+#include <semaphore.h> // provides recorder wake up and freewheel handshake
 #include <stdarg.h> // provides vfprintf
 #include <stdlib.h>
+#include <signal.h> // provides signal
 #include <string.h> // provides strcmp
+#include <time.h>   // provides clock_nanosleep
 #include <unistd.h>
 
 enum MIDI_MODE {
   MIDI_MODE_CC7 = 0,
   MIDI_MODE_CC14 = 1,
   MIDI_MODE_NRPN7 = 2,
-  MIDI_MODE_NRPN14 = 3
+  MIDI_MODE_NRPN14 = 3,
+  MIDI_MODE_CC16 = 4,
+  MIDI_MODE_NRPN16 = 5,
+  MIDI_MODE_COUNT
+};
+
+enum CURVE_TYPE {
+  CURVE_LINEAR = 0,
+  CURVE_GAMMA = 1,
+  CURVE_SCURVE = 2,
+  CURVE_INVERT = 3,
+  CURVE_FILE = 4
+};
+
+enum EVENT_FLAG {
+  EVENT_FLAG_16BIT = 0x01, // Value is 16-bit, written to slot and slot + 1
+  EVENT_FLAG_MASTER = 0x02, // Slot is master index, value is master level
+  EVENT_FLAG_GROUP = 0x04,  // Slot is group index, value is group level
+  EVENT_FLAG_EFFECT = 0x08, // Slot is effect index, value is effect level
+  EVENT_FLAG_RATE = 0x10,   // Slot is effect index, value is effect rate
+  EVENT_FLAG_CUE = 0x20,    // Slot is CUE_COMMAND, value is cue index
+  EVENT_FLAG_SCENE = 0x40   // Slot is SCENE_COMMAND, value is scene index
+};
+
+enum SHOW_RECORD {
+  SHOW_KEYFRAME = 0, // Data is whole frame
+  SHOW_DELTA = 1     // Data is XOR runs against previous frame
+};
+
+enum SCENE_COMMAND {
+  SCENE_RECALL = 0, // Copy scene to source layer
+  SCENE_CAPTURE = 1 // Copy merged universes to selected scene
+};
+
+enum CUE_COMMAND {
+  CUE_GO = 0,   // Run next cue
+  CUE_BACK = 1, // Return to previous cue
+  CUE_GOTO = 2  // Run cue by index
+};
+
+enum CC_FUNCTION {
+  CC_FUNC_NONE = 0,   // Decode by channel mode
+  CC_FUNC_FADE = 1,   // Set fade time
+  CC_FUNC_MASTER = 2, // Set master level (index in low byte)
+  CC_FUNC_GROUP = 3,  // Set group level (index in low byte)
+  CC_FUNC_EFFECT = 4, // Set effect level, 0 stops (index in low byte)
+  CC_FUNC_RATE = 5,   // Set effect rate (index in low byte)
+  CC_FUNC_CUE = 6,    // Cue command if value is not 0 (CUE_COMMAND in low byte)
+  CC_FUNC_BANK = 7,   // Select scene bank
+  CC_FUNC_CAPTURE = 8, // Capture selected scene if value is not 0
+  CC_FUNC_ENCODER = 9  // Adjust slot by relative value (ENCODER_MODE in low byte)
+};
+
+enum ENCODER_MODE {
+  ENCODER_TWOS = 0,   // Two's complement: 1..63 up, 127..64 down 1..64
+  ENCODER_OFFSET = 1, // Binary offset: 65..127 up 1..63, 63..0 down 1..64
+  ENCODER_SIGN = 2,   // Sign-magnitude: 1..63 up, 65..127 down 1..63
+  ENCODER_MODE_COUNT
+};
+
+enum EFFECT_SHAPE {
+  EFFECT_SINE = 0,   // Sine wave
+  EFFECT_SQUARE = 1, // Full for first half of cycle
+  EFFECT_RAMP = 2,   // Sawtooth rising from 0 to full
+  EFFECT_RANDOM = 3, // Random level each cycle
+  EFFECT_CHASE = 4,  // Full for 1 / (quantity of members) of cycle
+  EFFECT_SHAPE_COUNT
+};
+
+enum SYSEX_COMMAND {
+  SYSEX_DUMP_REQUEST = 0x01, // Request dump of universe range
+  SYSEX_DUMP_DATA = 0x02,    // Levels of slots of a universe
+  SYSEX_DUMP_END = 0x03      // End of dump
 };
 
 enum MIDI_COMMAND {
@@ -51,26 +219,388 @@ enum MIDI_COMMAND {
   MIDI_CMD_NULL = 127
 };
 
+struct MidiPort;
+typedef void (*CcHandler)(MidiPort *port, uint8_t channel, uint8_t cc,
+                          uint8_t val);
+
+struct ChannelState {
+  uint16_t bufferIndex; // Universe being adjusted (offset from first)
+  uint16_t slot;        // DMX slot being adjusted [0..511]
+  uint16_t nrpnParam;   // NRPN parameter being adjusted [0..16383]
+  uint8_t nrpnVal;      // NRPN value [0..255]
+  uint8_t cc14Val[32];  // 14-bit CC values
+  uint8_t ccMsb[32];    // 16-bit mode CC MSB values
+  uint16_t nrpnVal14;   // 16-bit mode NRPN value [0..16383]
+  uint16_t fadeTime;    // Fade time of changes in ms
+  uint16_t encoderVal[128]; // Value of each relative CC (16-bit in cc16)
+  jack_nframes_t encoderFrame[128]; // JACK frame of last relative CC
+};
+
+struct SlotTarget {
+  uint16_t universe; // DMX universe
+  uint16_t buffer;   // Arena universe index
+  uint16_t slot;     // DMX slot [0..511]
+  bool wide;         // True for 16-bit coarse/fine slot pair
+  bool enabled;      // True if target configured
+};
+
+struct MidiPort {
+  char name[64];          // JACK port name
+  jack_port_t *jackPort;  // Pointer to the JACK input port
+  uint8_t mode[16];       // MIDI mode of each MIDI channel
+  CcHandler ccHandler[16]; // CC decoder of each MIDI channel
+  uint16_t midiChannels;  // Bitwise flags for enabled MIDI channels
+  uint16_t universeBase;  // First DMX universe
+  uint16_t universeLast;  // Last DMX universe
+  uint16_t bufferBase;    // Arena index of first universe
+  uint16_t bufferCount;   // Quantity of arena universes addressed by port
+  ChannelState state[16]; // Decoder state of each MIDI channel
+  SlotTarget bend[16];    // Pitch bend target of each MIDI channel
+  SlotTarget pressure[16]; // Channel pressure target of each MIDI channel
+  uint16_t fadeTime;      // Default fade time in ms
+  uint8_t fadeCC;         // CC that sets fade time (0xff if none)
+  uint16_t masterCC[MAX_MASTERS]; // MIDI channel << 8 | CC of each master
+  uint16_t groupCC[MAX_GROUPS];   // MIDI channel << 8 | CC of each group
+  uint16_t effectNote[MAX_EFFECTS]; // MIDI channel << 8 | note of each effect
+  uint16_t effectCC[MAX_EFFECTS];   // MIDI channel << 8 | CC of each effect
+  uint16_t rateCC[MAX_EFFECTS];     // MIDI channel << 8 | CC of effect rate
+  uint16_t cueGo;         // MIDI channel << 8 | note of cue GO (0xffff none)
+  uint16_t cueBack;       // MIDI channel << 8 | note of cue BACK (0xffff none)
+  uint8_t cueChannel;     // MIDI channel of cue program change (0xff none)
+  uint8_t sceneChannel;   // MIDI channel of scene program change (0xff none)
+  uint8_t captureNote;    // Note that captures scene (0xff none)
+  uint8_t sceneBank;      // Bank selected by CC 0 on scene channel
+  uint16_t ccFunction[16][128]; // CC_FUNCTION << 8 | index [channel][cc]
+  uint16_t noteFunction[16][128]; // CC_FUNCTION << 8 | index [channel][note]
+  bool noteFade;          // True for note-on to fade to full over velocity
+  bool nrpnIncrement;     // True for NRPN data entry to advance to next slot
+  jack_port_t *outputPort; // Pointer to the JACK MIDI output port (or NULL)
+  uint16_t feedbackRate;  // Maximum feedback messages per second (0 none)
+  float feedbackCredit;   // Feedback messages that may be sent (RT thread)
+  bool dump;              // True to reply to SysEx dump requests
+  bool dumping;           // True while dump is in progress (RT thread)
+  uint16_t dumpBuffer;    // Arena universe being dumped (RT thread)
+  uint16_t dumpSlot;      // First slot of next dump message (RT thread)
+  uint16_t dumpEnd;       // Arena universe after last to dump (RT thread)
+};
+
+struct SlotEvent {
+  uint16_t buffer; // Arena universe index
+  uint16_t slot;   // DMX slot [0..511]
+  uint16_t value;  // DMX value [0..255] or [0..65535] if 16-bit
+  uint16_t fade;   // Time to fade to new value in ms
+  uint8_t source;  // Index of layer to change
+  uint8_t flags;   // Bitwise EVENT_FLAG
+  uint32_t due;    // Time to output (low 32 bits of JACK time in us)
+};
+
+struct SlotRange {
+  uint16_t universe; // DMX universe
+  uint16_t first;    // First DMX slot [0..511]
+  uint16_t last;     // Last DMX slot [0..511]
+};
+
+struct Curve {
+  uint8_t type;   // CURVE_TYPE
+  float gamma;    // Exponent of gamma curve
+  char path[256]; // Path of user lookup table file
+};
+
+struct CurveRange {
+  SlotRange range; // Slots using curve
+  uint8_t curve;   // Index of curve
+};
+
+struct GroupRange {
+  SlotRange range; // Member slots
+  uint16_t scale;  // Member level scale [0..256]
+  uint8_t group;   // Index of group
+};
+
+struct GroupMember {
+  uint16_t buffer; // Arena universe index
+  uint16_t slot;   // DMX slot [0..511]
+  uint16_t scale;  // Level scale [0..256]
+};
+
+struct Effect {
+  uint64_t phase;      // Cycles << 32 | position in cycle
+  uint32_t period;     // Cycle time in ms at default rate (0 if undefined)
+  uint32_t step;       // Phase increment each refresh period
+  uint32_t spreadStep; // Phase offset between adjacent members
+  float spread;        // Phase spread across all members in cycles
+  float beats;         // Cycle time in beats of MIDI clock (0 if in ms)
+  uint8_t group;       // Index of group
+  uint8_t shape;       // EFFECT_SHAPE
+  uint8_t level;       // Depth [0..255], 0 when stopped
+  uint8_t rate;        // Rate control [0..127], 64 runs at period
+};
+
+struct ClockState {
+  std::atomic<uint32_t> sequence{0}; // Odd while being written
+  std::atomic<int32_t> ticks{-1};    // Clocks since start (24 per beat)
+  std::atomic<uint32_t> frame{0};    // JACK frame of last clock
+  std::atomic<float> interval{0};    // Estimated frames between clocks
+  std::atomic<bool> running{false};  // True between start / continue and stop
+};
+
+/*  Show file: ShowHeader, then a ShowRecord and its data for each frame in
+    order, then the seek index (a ShowIndex for each keyframe).
+    A keyframe's data is each slot of each universe.
+    A delta's data is runs of a 16-bit quantity of unchanged slots, a 16-bit
+    quantity of changed slots, then for each changed slot its value XOR its
+    value in the previous frame. All values are little endian.
+*/
+struct ShowHeader {
+  char magic[8];      // "MIDISHW" null terminated
+  uint16_t version;   // Format version (1)
+  uint16_t universe;  // First universe of each frame
+  uint16_t universes; // Quantity of universes in each frame
+  uint16_t rate;      // Frames per second
+  uint32_t frames;    // Quantity of frames
+  uint32_t keyframes; // Quantity of entries in seek index
+  uint64_t index;     // Offset of seek index (0 if not written)
+};
+
+struct ShowRecord {
+  uint32_t frame; // Frame number, from 0
+  uint16_t type;  // SHOW_KEYFRAME or SHOW_DELTA
+  uint16_t spare; // Reserved (0)
+  uint32_t size;  // Bytes of data following record
+};
+
+struct ShowIndex {
+  uint32_t frame;  // Frame number of keyframe
+  uint32_t spare;  // Reserved (0)
+  uint64_t offset; // Offset of keyframe's ShowRecord in file
+};
+
+struct SceneHeader {
+  char magic[8];      // "MIDIOLA" null terminated
+  uint16_t version;   // Format version (1)
+  uint16_t universe;  // First universe of each scene
+  uint16_t universes; // Quantity of universes in each scene
+  uint16_t scenes;    // Quantity of scenes
+}; // Followed at offset DMX_SLOTS by scenes of universes of DMX_SLOTS slots
+
+struct CueChange {
+  uint16_t buffer; // Arena universe index
+  uint16_t slot;   // DMX slot [0..511]
+  uint8_t value;   // Value of slot
+};
+
+struct Cue {
+  uint32_t changes; // Index in g_cueChanges of GO changes, then BACK changes
+  uint32_t count;   // Quantity of GO changes (and of BACK changes)
+  uint16_t fade;    // Fade time in ms
+};
+
+struct Worker {
+  pthread_t thread;               // Render thread (unused for worker 0)
+  std::atomic<uint32_t> next;     // Index in g_pending of next to render
+  uint32_t end;                   // Index in g_pending after share
+} __attribute__((aligned(64))); // Avoid false sharing between workers
+
+// 16 byte vector, compiled to SSE2 / NEON where available
+typedef uint8_t v16u8 __attribute__((vector_size(16), may_alias));
+typedef int32_t v4i32 __attribute__((vector_size(16), may_alias));
+typedef uint32_t v4u32 __attribute__((vector_size(16), may_alias));
+typedef uint16_t v8u16 __attribute__((vector_size(16), may_alias));
+typedef uint8_t v8u8 __attribute__((vector_size(8), may_alias));
+
+template <typename T, uint32_t SIZE> struct Queue {
+  /*  @brief  Lock-free single producer, single consumer queue
+      @note   SIZE must be a power of 2
+      @note   Pushed items are not visible to consumer until published
+  */
+  T items[SIZE];
+  std::atomic<uint32_t> head{0}; // Index of next item to pop
+  std::atomic<uint32_t> tail{0}; // Index after last published item
+  uint32_t pending = 0;          // Index after last pushed item
+
+  bool push(const T &item) {
+    if (pending - head.load(std::memory_order_acquire) >= SIZE)
+      return false;
+    items[pending & (SIZE - 1)] = item;
+    ++pending;
+    return true;
+  }
+
+  void publish() { tail.store(pending, std::memory_order_release); }
+
+  bool peek(T &item) {
+    uint32_t index = head.load(std::memory_order_relaxed);
+    if (index == tail.load(std::memory_order_acquire))
+      return false;
+    item = items[index & (SIZE - 1)];
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t index = head.load(std::memory_order_relaxed);
+    if (index == tail.load(std::memory_order_acquire))
+      return false;
+    item = items[index & (SIZE - 1)];
+    head.store(index + 1, std::memory_order_release);
+    return true;
+  }
+};
+
 bool g_enableNote = false;      // True to listen for MIDI note-on command
 bool g_enableNoteOff = false;   // True to listen for MIDI note-off command
 bool g_enableCC = false;        // True to listen for MIDI CC command
-uint8_t g_universeBase = 1;     // First DMX universe
-uint8_t g_universe = 1;         // Current DMX universe
-uint8_t g_bufferIndex = 0;      // Index of dmx buffer used by current universe
-uint8_t g_mode = MIDI_MODE_CC7; // MIDI mode
-uint16_t g_midiChannels = 0xffff; // Bitwise flags for enabled MIDI channels
+bool g_enablePolyPressure = false; // True to listen for MIDI poly aftertouch
 uint8_t g_verbose =
     2; // Level of verbosity (0: silent, 1: errors, 2: info, 3: debug)
-uint16_t g_nrpnParam = 0;           // NRPN parameter being adjusted [0..16383]
-uint8_t g_nrpnVal = 0;              // NRPN value [0..255]
-uint16_t g_slot = 0;                // DMX slot being adjusted [0..511]
-jack_port_t *g_midiInputPort;       // Pointer to the JACK input port
+MidiPort g_ports[MAX_PORTS];    // MIDI input port configuration and state
+uint8_t g_portCount = 1;        // Quantity of MIDI input ports
+bool g_portNamed = false;       // True if first port named on command line
+uint16_t g_arenaBase = 1;       // DMX universe of first arena frame
+uint8_t g_layer[MAX_SOURCES][MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Universe arena, one layer per source
+uint8_t g_owner[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Source of latest change to each slot
+uint8_t g_effectOwner[MAX_UNIVERSE]
+                     [DMX_SLOTS]; // Owner of each slot before effects started
+uint8_t g_htp[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // 0xff for HTP slots, 0x00 for LTP slots
+uint8_t g_merged[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Merged universe frames
+uint8_t g_level[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Universe frames after fade
+uint8_t g_output[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Universe frames sent to OLA
+uint8_t g_dmxIn[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Universe frames received from OLA
+// True while slot is queued for feedback. Set by OLA input thread, cleared by
+// JACK process thread before reading the slot's latest value.
+std::atomic<bool> g_feedbackQueued[MAX_UNIVERSE][DMX_SLOTS];
+// Arena universe << 9 | slot of changed DMX input of each port
+Queue<uint32_t, FEEDBACK_QUEUE_SIZE> g_feedbackQueue[MAX_PORTS];
+std::atomic<uint32_t> g_feedbackOverflow{0}; // Quantity of dropped feedback
+uint8_t g_feedbackPort[MAX_UNIVERSE]; // Port feeding back universe (0xff none)
+pthread_t g_dmxInThread;              // OLA DMX input thread
+ola::io::SelectServer *g_dmxInServer = NULL; // OLA DMX input event loop
+uint8_t g_curve[MAX_UNIVERSE][DMX_SLOTS]; // Response curve index of each slot
+uint64_t g_curved[MAX_UNIVERSE / 64]; // Bitwise flags for universes with curves
+uint8_t g_curves[MAX_CURVES][256]; // Response curve lookup tables
+Curve g_curveDefs[MAX_CURVES];     // Response curve definitions
+uint8_t g_curveCount = 1;          // Quantity of curves (0 is linear)
+CurveRange g_curveRanges[MAX_RANGES]; // Slot ranges using each curve
+uint16_t g_curveRangeCount = 0;       // Quantity of curve slot ranges
+std::atomic<bool> g_reloadCurves{false}; // True to reload curves (SIGHUP)
+uint8_t g_masterLevel[MAX_MASTERS]; // Level of each master [0..255]
+uint8_t g_slotMaster[MAX_UNIVERSE][DMX_SLOTS]; // Submaster of each slot
+uint16_t g_scale[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Master scale of each slot [0..256]
+uint64_t g_masterUniverses[MAX_MASTERS][MAX_UNIVERSE / 64]; // Bitwise flags
+                                  // for universes with slots of each master
+uint64_t g_mastered[MAX_UNIVERSE / 64]; // Bitwise flags for scaled universes
+uint16_t g_mastersUsed = 0;      // Bitwise flags for masters controlled by CC
+SlotRange g_submasterRanges[MAX_RANGES]; // Slots of submasters
+uint8_t g_submasterIndex[MAX_RANGES];    // Submaster of each slot range
+uint16_t g_submasterRangeCount = 0;      // Quantity of submaster slot ranges
+GroupRange g_groupRanges[MAX_RANGES]; // Slot ranges of groups
+uint16_t g_groupRangeCount = 0;       // Quantity of group slot ranges
+GroupMember g_groupMembers[MAX_GROUP_MEMBERS]; // Members of all groups
+uint16_t g_groupStart[MAX_GROUPS + 1]; // Index of first member of each group
+Effect g_effects[MAX_EFFECTS];        // Effect definitions and state
+uint64_t g_effectUniverses[MAX_EFFECTS][MAX_UNIVERSE / 64]; // Effect universes
+uint32_t g_effectsRunning = 0;        // Bitwise flags for running effects
+uint8_t g_sine[256];                  // Sine wave starting at 0
+const char *effectShapes[] = {"sine", "square", "ramp", "random", "chase"};
+char g_cuePath[256] = "";       // Path of cue file (empty if none)
+Cue *g_cues = NULL;             // Cue stack
+uint16_t g_cueCount = 0;        // Quantity of cues
+CueChange *g_cueChanges = NULL; // Slot changes of all cues
+uint32_t g_cueChangeCount = 0;  // Quantity of slot changes of all cues
+int32_t g_cue = -1;             // Index of current cue (-1 before first cue)
+char g_scenePath[256] = "";     // Path of scene bank file (empty if none)
+uint16_t g_newScenes = DEFAULT_SCENES; // Quantity of scenes if creating bank
+SceneHeader *g_sceneBank = NULL; // Memory mapped scene bank
+uint8_t *g_scenes = NULL;        // First slot of first scene in bank
+size_t g_sceneBankSize = 0;      // Size of mapped scene bank in bytes
+uint16_t g_scene = 0;            // Index of last selected scene
+std::atomic<bool> g_captureScene{false}; // True to capture scene (SIGUSR1)
+uint16_t g_fadeTime[MAX_UNIVERSE][DMX_SLOTS]; // Fade time of last change (ms)
+uint8_t g_fadeTarget[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Value each slot is fading to
+int32_t g_fadeLevel[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Current fade level (16.16 fixed point)
+int32_t g_fadeStep[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Fade level change per refresh period
+int32_t g_fadeTicks[MAX_UNIVERSE][DMX_SLOTS]
+    __attribute__((aligned(16))); // Refresh periods remaining in fade
+uint64_t g_fading[MAX_UNIVERSE / 64]; // Bitwise flags for fading universes
+uint32_t g_sourceMask[MAX_UNIVERSE]; // Bitwise flags for sources in universe
+uint64_t g_dirty[MAX_UNIVERSE / 64]; // Bitwise flags for changed universes
+SlotRange g_htpRanges[MAX_RANGES]; // Slot ranges configured as HTP
+uint16_t g_htpRangeCount = 0;      // Quantity of HTP slot ranges
+Queue<SlotEvent, EVENT_QUEUE_SIZE> g_eventQueue; // Slot changes from MIDI
+SlotEvent g_heldEvents[EVENT_QUEUE_SIZE]; // Slot changes not yet due
+uint32_t g_heldCount = 0; // Quantity of held slot changes
+std::atomic<uint32_t> g_eventOverflow{0}; // Quantity of dropped slot changes
+uint16_t g_refreshRate = DEFAULT_REFRESH; // Output refresh rate (Hz)
+bool g_align = false;           // True to align output with audio
+uint16_t g_fixtureLatency = 0;  // Time from DMX send to light output (ms)
+std::atomic<uint32_t> g_playbackLatency{0}; // Audio playback latency (us)
+std::atomic<bool> g_latencyChanged{true};   // True to update latency
+uint32_t g_eventDue = 0; // Output time of MIDI event being processed (us)
+int8_t g_clockPort = -1;    // Index of port following MIDI clock (-1 none)
+ClockState g_clock;         // MIDI clock published to output thread
+float g_clockInterval = 0;  // Estimated frames between clocks (RT thread)
+uint32_t g_clockFrame = 0;  // JACK frame of last clock (RT thread)
+int32_t g_clockTicks = -1;  // Clocks since start (RT thread)
+uint8_t g_clockOutliers = 0; // Consecutive clocks outside tolerance
+int8_t g_mtcPort = -1;      // Index of port following MIDI Time Code (-1 none)
+uint8_t g_mtcPiece[8];      // Received MTC quarter frame values (RT thread)
+uint8_t g_mtcPieces = 0;    // Bitwise flags for received quarter frames
+// Show position: running flag << 63 | valid flag << 62 | time in ms << 32 |
+// JACK frame at that time
+std::atomic<uint64_t> g_showPosition{0};
+bool g_transport = false;   // True to play show following JACK transport
+char g_showPath[256] = "";  // Path of show file to play (empty if none)
+uint8_t *g_show = NULL;     // Memory mapped show file
+size_t g_showSize = 0;      // Size of show file in bytes
+ShowHeader g_showHeader;    // Header of show file
+ShowIndex *g_showIndex = NULL; // Seek index of show file
+int64_t g_showFrame = -1;   // Frame number in show layer (-1 none)
+size_t g_showNext = 0;      // Offset of record after current frame
+size_t g_showReadahead = 0; // Offset read ahead to
+char g_recordPath[256] = "";  // Path of show file to record (empty if none)
+uint16_t g_recordUniverses = 0; // Quantity of universes recorded
+uint8_t *g_recordFrames = NULL; // Ring of RECORD_QUEUE queued frames
+// Frame numbers to record. Half the ring so frames being encoded are not
+// overwritten.
+Queue<uint32_t, RECORD_QUEUE / 2> g_recordQueue;
+uint32_t g_recordFrame = 0;   // Frame number of next frame to queue
+uint32_t g_recordQueued = 0;  // Quantity of frames queued (output thread)
+bool g_recordFull = false;    // True while recorder queue is full
+std::atomic<uint32_t> g_recordDropped{0}; // Frames dropped (queue full)
+pthread_t g_recordThread;     // Recorder thread
+sem_t g_recordWake;           // Posted when a frame is queued or to stop
+std::atomic<bool> g_recordStop{false}; // True to stop recorder
+std::atomic<bool> g_stop{false};       // True to exit (SIGINT, SIGTERM)
+std::atomic<bool> g_freewheel{false};  // True while JACK is freewheeling
+uint64_t g_freewheelFrames = 0; // Audio frames x refresh rate not yet rendered
+sem_t g_freewheelTick; // Posted by JACK process thread to render a frame
+sem_t g_freewheelDone; // Posted by output thread when frame is rendered
+uint8_t g_threads = 1;        // Quantity of render threads (incl. output)
+bool g_benchmark = false;     // True to benchmark rendering then exit
+Worker g_workers[MAX_THREADS]; // Render threads, 0 is the output thread
+pthread_barrier_t g_renderStart; // Releases render threads each period
+pthread_barrier_t g_renderDone;  // Waits for render threads to finish
+bool g_renderStop = false;       // True to end render threads
+uint16_t g_pending[MAX_UNIVERSE]; // Arena indicies of universes to render
+uint16_t g_pendingCount = 0;      // Quantity of universes to render
+bool g_pendingFading[MAX_UNIVERSE]; // True if pending universe still fading
 jack_client_t *g_jackClient = NULL; // Pointer to the JACK client
-ola::DmxBuffer g_dmxBuffer[MAX_MIDI_UNIVERSE]; // DMX data buffer for universe
+ola::DmxBuffer g_dmxBuffer; // DMX data buffer used to send universe to OLA
 ola::client::StreamingClient *g_olaClient = NULL; // Pointer to the OLA client
 char g_jackname[256]; // JACK client name
 
-const char *modeNames[] = {"cc7", "cc14", "nrpn7", "nrpn14"};
+const char *modeNames[] = {"cc7", "cc14", "nrpn7", "nrpn14", "cc16", "nrpn16"};
+const char *encoderModes[] = {"twos", "offset", "sign"};
 
 void debug(const char *format, ...) {
   if (g_verbose > 2) {
@@ -100,19 +630,120 @@ void error(const char *format, ...) {
   }
 }
 
+void infoChannels(uint16_t mask) {
+  /*  @brief  Show list of MIDI channels
+      @param  mask Bitwise flags of MIDI channels
+  */
+
+  bool comma = false;
+  for (uint8_t chan = 0; chan < 16; ++chan) {
+    if ((1 << chan) & mask) {
+      if (comma)
+        info(", %u", chan + 1);
+      else {
+        info("%u", chan + 1);
+        comma = true;
+      }
+    }
+  }
+  info("\n");
+}
+
 void help() {
   info("Usage: jackmidiola [options]\n\n"
        "Options:\n"
        "  -h --help        Show this help.\n"
-       "  -u --universe    First universe (default: 1).\n"
+       "  -p --port        Add MIDI input port with given name (default: "
+       "input). Following -m, -u and -x options apply to this port.\n"
+       "  -u --universe    First universe, optionally with last universe, "
+       "e.g. 5-8 (default: 1).\n"
        "  -n --note        Listen for MIDI note-on (disabled by default).\n"
        "  -o --noteoff     Listen for MIDI note-off (disabled by default).\n"
+       "  -a --aftertouch  Listen for MIDI polyphonic aftertouch, setting slot "
+       "of note (disabled by default).\n"
+       "  -A --pressure    Map channel pressure (aftertouch) of MIDI channel to "
+       "slot, e.g. 1=2.101 or 1=2.101:16. Can be provided multiple times. "
+       "Applies to current port.\n"
+       "  -f --fade        Fade time in ms of changes (default: 0). Applies to "
+       "current port.\n"
+       "  -F --fadecc      CC that sets fade time of following changes on its "
+       "MIDI channel, 100ms per step. Applies to current port.\n"
+       "  -t --notefade    Note-on fades slot to full over time set by "
+       "velocity, 100ms per step. Applies to current port.\n"
+       "  -C --curve       Apply response curve to slots, e.g. 1.1-24=gamma:2.2. "
+       "Curves: linear, gamma[:exponent] (default 2.2), scurve, invert or "
+       "path of file with 256 values. Can be provided multiple times.\n"
+       "  -M --master      Control master by MIDI channel and CC, e.g. 0=16.7 "
+       "controls grand master (0) by CC 7 on MIDI channel 16 and 1=16.1 "
+       "controls submaster 1 (1..15). Applies to current port.\n"
+       "  -S --submaster   Add slots to submaster, e.g. 1=1.1-24. Can be "
+       "provided multiple times.\n"
+       "  -g --group       Add slots to group (1..64), with optional level "
+       "scale, e.g. 1=1.1-24,2.1-24*0.5. Can be provided multiple times.\n"
+       "  -G --groupcc     Control group by MIDI channel and CC, e.g. 1=16.20. "
+       "Applies to current port.\n"
+       "  -e --effect      Define effect (1..32) on group as "
+       "group:shape[:period[:spread]], shape is sine, square, ramp, random or "
+       "chase, period in ms (default 1000), spread in cycles across members, "
+       "e.g. 1=2:sine:2000:1\n"
+       "  -E --effectnote  Start (note-on) and stop (note-off) effect by MIDI "
+       "channel and note, velocity sets level, e.g. 1=16.60. Applies to "
+       "current port.\n"
+       "  -L --effectlevel Control effect level by MIDI channel and CC, 0 "
+       "stops, e.g. 1=16.30. Applies to current port.\n"
+       "  -R --effectrate  Control effect rate by MIDI channel and CC, 64 runs "
+       "at period, e.g. 1=16.31. Applies to current port.\n"
+       "  -T --threads     Quantity of threads rendering universes (1..16, "
+       "default 1)\n"
+       "  -B --benchmark   Show render time against quantity of threads and "
+       "universes then exit\n"
+       "  -q --cues        Load cue stack from file\n"
+       "  -Q --cuenotes    MIDI channel and notes of cue GO and BACK, e.g. "
+       "16.60.59. Applies to current port.\n"
+       "  -P --cueprogram  MIDI channel of program change that runs cue by "
+       "position in stack (program 0 is cue 1). Applies to current port.\n"
+       "  -k --scenes      Load scene bank file, created with optional "
+       "quantity of scenes if it does not exist, e.g. show.scn:256\n"
+       "  -K --scenechannel MIDI channel of program change (and bank select) "
+       "that recalls scene, with optional note that captures it, e.g. 15.0. "
+       "Applies to current port.\n"
+       "  -l --latency     Align output with audio using MIDI event time "
+       "and audio playback latency, less fixture latency in ms, e.g. 20\n"
+       "  -Y --clock       Follow MIDI clock received on current port. "
+       "Effects with period in beats, e.g. 1=2:chase:4b, lock to the clock.\n"
+       "  -w --show        Play show file locked to MIDI Time Code or JACK "
+       "transport\n"
+       "  -W --mtc         Follow MIDI Time Code received on current port\n"
+       "  -X --transport   Play show file following JACK transport\n"
+       "  -i --feedback    Send MIDI on output port for changes of DMX received "
+       "from OLA on port's universes, at up to given messages per second, "
+       "e.g. 1000. Applies to current port.\n"
+       "  -d --dump        Reply to SysEx request with dump of levels on "
+       "output port. Applies to current port.\n"
+       "  -N --encoder     Decode MIDI channel and CC (or CC range) as "
+       "relative (endless encoder), accelerated by turn rate, with mode twos "
+       "(default), offset or sign, e.g. 1.20-27:offset. Can be provided "
+       "multiple times. Applies to current port.\n"
+       "  -I --nrpninc     NRPN data entry advances to next slot (pair in "
+       "nrpn16), so consecutive slots need no NRPN select. Applies to current "
+       "port.\n"
+       "  -z --record      Record output of universes of all ports to show "
+       "file\n"
        "  -c --cc          Listen for MIDI CC (enabled by default but disabled "
        "if not specified when note-on is enabled).\n"
        "  -x --exclude     Do not listen on MIDI channel (1..16 Can be "
        "provided multiple times).\n"
        "  -j --jackname    Name of jack client (default: midiola)\n"
-       "  -m --mode        MIDI mode:\n"
+       "  -b --bend        Map pitch bend of MIDI channel to slot, e.g. "
+       "1=2.101 or to 16-bit coarse/fine slot pair, e.g. 1=2.101:16. Can be "
+       "provided multiple times. Applies to current port.\n"
+       "  -H --htp         Merge slots highest-takes-precedence (intensity), "
+       "e.g. 1.1-24 or 2 for whole universe 2. Can be provided multiple "
+       "times. Other slots are latest-takes-precedence.\n"
+       "  -r --rate        Output refresh rate in Hz (default: 44).\n"
+       "  -m --mode        MIDI mode, optionally followed by MIDI channels "
+       "using this mode, e.g. nrpn14:1-4,6 (default: all channels). Can be "
+       "provided multiple times:\n"
        "    cc7   : CC 0..127 control slots 1..128. MIDI channel = universe "
        "(default).\n"
        "    cc14  : CC 0..31 (MSB) 32..63 (LSB) control slots 1..32. MIDI "
@@ -122,6 +753,10 @@ void help() {
        "(x32).\n"
        "    nrpn14: Same as nrpn7 with 8-bit DMX data, sent when LSB is "
        "received from CC 38.\n"
+       "    cc16  : CC 0..31 (MSB) 32..63 (LSB) control 16-bit coarse/fine slot "
+       "pairs 1+2..63+64. MIDI channel = universe. Sent when LSB received.\n"
+       "    nrpn16: Same as nrpn14 with 14-bit data scaled to 16-bit "
+       "coarse/fine slot pair at NRPN slot and following slot.\n"
        "  -v --version     Show version.\n"
        "  -V --verbose     Set verbose level:\n"
        "    0: Silent\n"
@@ -130,6 +765,367 @@ void help() {
        "    3: Show debug\n");
 }
 
+void initPort(MidiPort *port, const char *name) {
+  /*  @brief  Initialise MIDI input port configuration with default values
+      @param  port Pointer to port
+      @param  name Name of JACK port
+  */
+
+  memset(port, 0, sizeof(MidiPort));
+  strcpy(port->name, name);
+  memset(port->mode, MIDI_MODE_CC7, sizeof(port->mode));
+  port->midiChannels = 0xffff;
+  port->universeBase = 1;
+  port->universeLast = 0xffff;
+  port->fadeCC = 0xff;
+  for (uint8_t i = 0; i < MAX_MASTERS; ++i)
+    port->masterCC[i] = 0xffff;
+  for (uint8_t i = 0; i < MAX_GROUPS; ++i)
+    port->groupCC[i] = 0xffff;
+  port->cueGo = 0xffff;
+  port->cueBack = 0xffff;
+  port->cueChannel = 0xff;
+  port->sceneChannel = 0xff;
+  port->captureNote = 0xff;
+  port->sceneBank = 0;
+  for (uint8_t i = 0; i < MAX_EFFECTS; ++i) {
+    port->effectNote[i] = 0xffff;
+    port->effectCC[i] = 0xffff;
+    port->rateCC[i] = 0xffff;
+  }
+}
+
+bool parseSlotRange(const char *str, SlotRange *range) {
+  /*  @brief  Parse slot range from string
+      @param  str String in form universe[.first[-last]], slots 1..512
+      @param  range Pointer to range to populate
+      @retval bool True on success
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  long universe = strtol(str, &end, 10);
+  long first = 1, last = DMX_SLOTS;
+  if (end == str || universe < 0 || universe > 0xffff)
+    return false;
+  if (*end == '.') {
+    const char *start = end + 1;
+    first = last = strtol(start, &end, 10);
+    if (end == start)
+      return false;
+    if (*end == '-') {
+      start = end + 1;
+      last = strtol(start, &end, 10);
+      if (end == start)
+        return false;
+    }
+  }
+  if (*end || first < 1 || last < first || last > DMX_SLOTS)
+    return false;
+  range->universe = universe;
+  range->first = first - 1;
+  range->last = last - 1;
+  return true;
+}
+
+bool parseChannels(const char *str, uint16_t *mask) {
+  /*  @brief  Parse list of MIDI channels from string
+      @param  str String of comma separated channels or ranges, e.g. 1-4,10
+      @param  mask Pointer to bitwise flags to populate
+      @retval bool True on success
+  */
+
+  *mask = 0;
+  const char *start = str;
+  while (true) {
+    char *end;
+    long first = strtol(start, &end, 10);
+    long last = first;
+    if (end == start)
+      return false;
+    if (*end == '-') {
+      start = end + 1;
+      last = strtol(start, &end, 10);
+      if (end == start)
+        return false;
+    }
+    if (first < 1 || last < first || last > 16)
+      return false;
+    for (long chan = first; chan <= last; ++chan)
+      *mask |= 1 << (chan - 1);
+    if (*end == 0)
+      return true;
+    if (*end != ',')
+      return false;
+    start = end + 1;
+  }
+}
+
+bool parseTarget(const char *str, uint8_t *channel, SlotTarget *target) {
+  /*  @brief  Parse MIDI channel to slot mapping from string
+      @param  str String in form channel=universe.slot[:16], channel 1..16,
+     slot 1..512, :16 for 16-bit coarse/fine pair
+      @param  channel Pointer to MIDI channel [0..15] to populate
+      @param  target Pointer to target to populate
+      @retval bool True on success
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  const char *start = str;
+  long chan = strtol(start, &end, 10);
+  if (end == start || *end != '=' || chan < 1 || chan > 16)
+    return false;
+  start = end + 1;
+  long universe = strtol(start, &end, 10);
+  if (end == start || *end != '.' || universe < 0 || universe > 0xffff)
+    return false;
+  start = end + 1;
+  long slot = strtol(start, &end, 10);
+  if (end == start || slot < 1 || slot > DMX_SLOTS)
+    return false;
+  bool wide = false;
+  if (strcmp(end, ":16") == 0)
+    wide = true;
+  else if (*end)
+    return false;
+  if (wide && slot == DMX_SLOTS)
+    return false;
+  *channel = chan - 1;
+  target->universe = universe;
+  target->slot = slot - 1;
+  target->wide = wide;
+  target->enabled = true;
+  return true;
+}
+
+bool parseCurve(const char *str, CurveRange *curveRange) {
+  /*  @brief  Parse response curve assignment from string
+      @param  str String in form range=curve, e.g. 1.1-24=gamma:2.2
+      @param  curveRange Pointer to curve range to populate
+      @retval bool True on success
+      @note   Adds curve definition to g_curveDefs
+  */
+
+  if (!str)
+    return false;
+  const char *equals = strchr(str, '=');
+  if (!equals || equals - str >= 32)
+    return false;
+  char rangeStr[32];
+  memcpy(rangeStr, str, equals - str);
+  rangeStr[equals - str] = 0;
+  if (!parseSlotRange(rangeStr, &curveRange->range))
+    return false;
+  const char *name = equals + 1;
+  if (strcmp(name, "linear") == 0) {
+    curveRange->curve = 0;
+    return true;
+  }
+  if (g_curveCount >= MAX_CURVES)
+    return false;
+  Curve *curve = &g_curveDefs[g_curveCount];
+  curve->gamma = 2.2;
+  if (strcmp(name, "gamma") == 0) {
+    curve->type = CURVE_GAMMA;
+  } else if (strncmp(name, "gamma:", 6) == 0) {
+    curve->type = CURVE_GAMMA;
+    curve->gamma = atof(name + 6);
+    if (curve->gamma <= 0)
+      return false;
+  } else if (strcmp(name, "scurve") == 0) {
+    curve->type = CURVE_SCURVE;
+  } else if (strcmp(name, "invert") == 0) {
+    curve->type = CURVE_INVERT;
+  } else if (*name && strlen(name) < sizeof(curve->path)) {
+    curve->type = CURVE_FILE;
+    strcpy(curve->path, name);
+  } else {
+    return false;
+  }
+  curveRange->curve = g_curveCount++;
+  return true;
+}
+
+bool parseChannelCC(const char *str, long max, long *index, uint16_t *chanCC) {
+  /*  @brief  Parse assignment of MIDI channel and CC from string
+      @param  str String in form index=channel.cc, e.g. 1=16.20
+      @param  max Maximum index
+      @param  index Pointer to index to populate
+      @param  chanCC Pointer to populate with MIDI channel << 8 | CC
+      @retval bool True on success
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  *index = strtol(str, &end, 10);
+  if (end == str || *end != '=' || *index < 0 || *index > max)
+    return false;
+  const char *start = end + 1;
+  long chan = strtol(start, &end, 10);
+  if (end == start || *end != '.' || chan < 1 || chan > 16)
+    return false;
+  start = end + 1;
+  long cc = strtol(start, &end, 10);
+  if (end == start || *end || cc < 0 || cc > 127)
+    return false;
+  *chanCC = ((chan - 1) << 8) | cc;
+  return true;
+}
+
+bool parseEncoder(MidiPort *port, const char *str) {
+  /*  @brief  Parse relative CCs (endless encoders) of a port from string
+      @param  port Pointer to port
+      @param  str String in form channel.cc[-cc][:mode], e.g. 1.20-27:offset
+      @retval bool True on success
+      @note   Mode is twos (default), offset or sign
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  long chan = strtol(str, &end, 10);
+  if (end == str || *end != '.' || chan < 1 || chan > 16)
+    return false;
+  const char *start = end + 1;
+  long first = strtol(start, &end, 10);
+  long last = first;
+  if (end == start || first < 0 || first > 127)
+    return false;
+  if (*end == '-') {
+    start = end + 1;
+    last = strtol(start, &end, 10);
+    if (end == start || last < first || last > 127)
+      return false;
+  }
+  uint8_t mode = ENCODER_TWOS;
+  if (*end == ':') {
+    for (mode = 0; mode < ENCODER_MODE_COUNT; ++mode)
+      if (strcmp(end + 1, encoderModes[mode]) == 0)
+        break;
+    if (mode == ENCODER_MODE_COUNT)
+      return false;
+  } else if (*end) {
+    return false;
+  }
+  for (long cc = first; cc <= last; ++cc)
+    port->ccFunction[chan - 1][cc] = (CC_FUNC_ENCODER << 8) | mode;
+  return true;
+}
+
+bool parseGroup(const char *str) {
+  /*  @brief  Parse group members from string
+      @param  str String in form group=range[*scale][,range[*scale]...], e.g.
+     1=1.1-24,2.1-24*0.5
+      @retval bool True on success
+      @note   Adds ranges to g_groupRanges
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  long group = strtol(str, &end, 10);
+  if (end == str || *end != '=' || group < 1 || group > MAX_GROUPS)
+    return false;
+  const char *start = end + 1;
+  while (true) {
+    if (g_groupRangeCount >= MAX_RANGES)
+      return false;
+    GroupRange *groupRange = &g_groupRanges[g_groupRangeCount];
+    size_t len = strcspn(start, "*,");
+    char rangeStr[32];
+    if (len >= sizeof(rangeStr))
+      return false;
+    memcpy(rangeStr, start, len);
+    rangeStr[len] = 0;
+    if (!parseSlotRange(rangeStr, &groupRange->range))
+      return false;
+    groupRange->group = group - 1;
+    groupRange->scale = 256;
+    start += len;
+    if (*start == '*') {
+      float scale = strtof(start + 1, &end);
+      if (end == start + 1 || scale < 0 || scale > 1)
+        return false;
+      groupRange->scale = lroundf(scale * 256);
+      start = end;
+    }
+    ++g_groupRangeCount;
+    if (*start == 0)
+      return true;
+    if (*start != ',')
+      return false;
+    ++start;
+  }
+}
+
+bool parseEffect(const char *str) {
+  /*  @brief  Parse effect definition from string
+      @param  str String in form effect=group:shape[:period[:spread]], e.g.
+     1=2:sine:2000:1, period in ms or beats of MIDI clock with suffix b
+      @retval bool True on success
+      @note   Populates g_effects
+  */
+
+  if (!str)
+    return false;
+  char *end;
+  long index = strtol(str, &end, 10);
+  if (end == str || *end != '=' || index < 1 || index > MAX_EFFECTS)
+    return false;
+  const char *start = end + 1;
+  long group = strtol(start, &end, 10);
+  if (end == start || *end != ':' || group < 1 || group > MAX_GROUPS)
+    return false;
+  start = end + 1;
+  size_t len = strcspn(start, ":");
+  uint8_t shape;
+  for (shape = 0; shape < EFFECT_SHAPE_COUNT; ++shape)
+    if (strlen(effectShapes[shape]) == len &&
+        strncmp(start, effectShapes[shape], len) == 0)
+      break;
+  if (shape == EFFECT_SHAPE_COUNT)
+    return false;
+  long period = 1000;
+  float beats = 0;
+  float spread = shape == EFFECT_CHASE ? 1 : 0;
+  start += len;
+  if (*start == ':') {
+    ++start;
+    period = strtol(start, &end, 10);
+    if (*end == '.' || *end == 'b') {
+      beats = strtof(start, &end);
+      if (end == start || *end != 'b' || beats <= 0)
+        return false;
+      ++end;
+      period = 1000;
+    } else if (end == start || period < 1 || period > 3600000) {
+      return false;
+    }
+    start = end;
+    if (*start == ':') {
+      ++start;
+      spread = strtof(start, &end);
+      if (end == start || spread < 0)
+        return false;
+      start = end;
+    }
+  }
+  if (*start)
+    return false;
+  Effect *effect = &g_effects[index - 1];
+  effect->group = group - 1;
+  effect->shape = shape;
+  effect->period = period;
+  effect->beats = beats;
+  effect->spread = spread;
+  effect->rate = 64;
+  return true;
+}
+
 void parseCommandLine(int argc, char *argv[]) {
   option longopts[] = {{"mode", optional_argument, NULL, 'm'},
                        {"universe", optional_argument, NULL, 'u'},
@@ -141,9 +1137,49 @@ void parseCommandLine(int argc, char *argv[]) {
                        {"exclude", optional_argument, NULL, 'x'},
                        {"help", optional_argument, NULL, 'h'},
                        {"jackname", optional_argument, NULL, 'j'},
+                       {"port", required_argument, NULL, 'p'},
+                       {"rate", required_argument, NULL, 'r'},
+                       {"htp", required_argument, NULL, 'H'},
+                       {"bend", required_argument, NULL, 'b'},
+                       {"aftertouch", no_argument, NULL, 'a'},
+                       {"pressure", required_argument, NULL, 'A'},
+                       {"fade", required_argument, NULL, 'f'},
+                       {"fadecc", required_argument, NULL, 'F'},
+                       {"notefade", no_argument, NULL, 't'},
+                       {"curve", required_argument, NULL, 'C'},
+                       {"master", required_argument, NULL, 'M'},
+                       {"submaster", required_argument, NULL, 'S'},
+                       {"group", required_argument, NULL, 'g'},
+                       {"groupcc", required_argument, NULL, 'G'},
+                       {"threads", required_argument, NULL, 'T'},
+                       {"latency", required_argument, NULL, 'l'},
+                       {"clock", no_argument, NULL, 'Y'},
+                       {"show", required_argument, NULL, 'w'},
+                       {"mtc", no_argument, NULL, 'W'},
+                       {"transport", no_argument, NULL, 'X'},
+                       {"record", required_argument, NULL, 'z'},
+                       {"feedback", required_argument, NULL, 'i'},
+                       {"dump", no_argument, NULL, 'd'},
+                       {"encoder", required_argument, NULL, 'N'},
+                       {"nrpninc", no_argument, NULL, 'I'},
+                       {"benchmark", no_argument, NULL, 'B'},
+                       {"cues", required_argument, NULL, 'q'},
+                       {"cuenotes", required_argument, NULL, 'Q'},
+                       {"cueprogram", required_argument, NULL, 'P'},
+                       {"scenes", required_argument, NULL, 'k'},
+                       {"scenechannel", required_argument, NULL, 'K'},
+                       {"effect", required_argument, NULL, 'e'},
+                       {"effectnote", required_argument, NULL, 'E'},
+                       {"effectlevel", required_argument, NULL, 'L'},
+                       {"effectrate", required_argument, NULL, 'R'},
                        {NULL, 0, 0, 0}};
+  initPort(&g_ports[0], "input");
+  MidiPort *port = &g_ports[0]; // Port being configured
   while (1) {
-    const int opt = getopt_long(argc, argv, "chnovj:m:u:V:x:", longopts, 0);
+    const int opt =
+        getopt_long(argc, argv,
+                    "achdnotvA:Bb:C:e:E:f:F:g:G:i:Ij:k:K:l:L:m:M:N:p:P:q:Q:r:R:S:T:u:H:V:w:Wx:XYz:",
+                    longopts, 0);
     if (opt == -1) {
       break;
     }
@@ -151,28 +1187,204 @@ void parseCommandLine(int argc, char *argv[]) {
     case ':':
       error("Expected value for %c\n", optopt);
       exit(1);
-    case 'm':
-      g_mode = -1;
+    case 'p':
+      if (!optarg || strlen(optarg) >= sizeof(port->name)) {
+        error("Port name must be less than %u characters.\n",
+              (unsigned)sizeof(port->name));
+        exit(1);
+      }
+      if (g_portNamed) {
+        if (g_portCount >= MAX_PORTS) {
+          error("Maximum %u ports.\n", MAX_PORTS);
+          exit(1);
+        }
+        port = &g_ports[g_portCount++];
+        initPort(port, optarg);
+      } else {
+        strcpy(port->name, optarg);
+        g_portNamed = true;
+      }
+      break;
+    case 'm': {
+      uint8_t mode = -1;
+      uint16_t channels = 0xffff;
       if (optarg) {
-        for (uint8_t i = 0; i < 4; ++i) {
-          if (strcmp(optarg, modeNames[i]) == 0) {
-            g_mode = i;
+        const char *colon = strchr(optarg, ':');
+        size_t len = colon ? (size_t)(colon - optarg) : strlen(optarg);
+        for (uint8_t i = 0; i < MIDI_MODE_COUNT; ++i) {
+          if (strlen(modeNames[i]) == len &&
+              strncmp(optarg, modeNames[i], len) == 0) {
+            mode = i;
             break;
           }
         }
+        if (colon && !parseChannels(colon + 1, &channels)) {
+          error("Invalid mode channels. Expects list of 1..16, e.g. 1-4,6\n");
+          exit(1);
+        }
       }
-      if (g_mode <= MIDI_MODE_NRPN14)
+      if (mode < MIDI_MODE_COUNT) {
+        for (uint8_t chan = 0; chan < 16; ++chan)
+          if (channels & (1 << chan))
+            port->mode[chan] = mode;
         break;
-      error("Invalid mode. Expects: cc7, cc14, nrpn7 or nrpn14\n");
+      }
+      error("Invalid mode. Expects: cc7, cc14, nrpn7, nrpn14, cc16 or "
+            "nrpn16\n");
       exit(1);
+    }
     case 'u':
       if (optarg) {
-        g_universe = atoi(optarg);
-        g_universeBase = g_universe;
+        char *end;
+        long first = strtol(optarg, &end, 10);
+        long last = 0xffff;
+        if (*end == '-')
+          last = strtol(end + 1, &end, 10);
+        if (end != optarg && *end == 0 && first >= 0 && last >= first &&
+            last <= 0xffff) {
+          port->universeBase = first;
+          port->universeLast = last;
+          break;
+        }
+      }
+      error("Invalid universe. Must be number or range, e.g. 5-8.\n");
+      exit(1);
+    case 'H':
+      if (g_htpRangeCount < MAX_RANGES &&
+          parseSlotRange(optarg, &g_htpRanges[g_htpRangeCount])) {
+        ++g_htpRangeCount;
+        break;
+      }
+      error("Invalid HTP range. Expects universe[.first[-last]], e.g. "
+            "1.1-24\n");
+      exit(1);
+    case 'b': {
+      uint8_t chan;
+      SlotTarget target;
+      if (parseTarget(optarg, &chan, &target)) {
+        port->bend[chan] = target;
+        break;
+      }
+      error("Invalid pitch bend mapping. Expects channel=universe.slot[:16], "
+            "e.g. 1=2.101\n");
+      exit(1);
+    }
+    case 'A': {
+      uint8_t chan;
+      SlotTarget target;
+      if (parseTarget(optarg, &chan, &target)) {
+        port->pressure[chan] = target;
+        break;
+      }
+      error("Invalid pressure mapping. Expects channel=universe.slot[:16], "
+            "e.g. 1=2.101\n");
+      exit(1);
+    }
+    case 'a':
+      g_enablePolyPressure = true;
+      break;
+    case 'f':
+      if (optarg) {
+        char *end;
+        long ms = strtol(optarg, &end, 10);
+        if (end != optarg && *end == 0 && ms >= 0 && ms <= 0xffff) {
+          port->fadeTime = ms;
+          break;
+        }
+      }
+      error("Fade time must be in range 0..65535 ms\n");
+      exit(1);
+    case 'F':
+      if (optarg) {
+        char *end;
+        long cc = strtol(optarg, &end, 10);
+        if (end != optarg && *end == 0 && cc >= 0 && cc <= 127) {
+          port->fadeCC = cc;
+          break;
+        }
+      }
+      error("Fade CC must be in range 0..127\n");
+      exit(1);
+    case 't':
+      port->noteFade = true;
+      break;
+    case 'I':
+      port->nrpnIncrement = true;
+      break;
+    case 'C':
+      if (g_curveRangeCount < MAX_RANGES &&
+          parseCurve(optarg, &g_curveRanges[g_curveRangeCount])) {
+        ++g_curveRangeCount;
+        break;
+      }
+      error("Invalid curve. Expects universe[.first[-last]]=curve, e.g. "
+            "1.1-24=gamma:2.2\n");
+      exit(1);
+    case 'M': {
+      long master;
+      uint16_t chanCC;
+      if (parseChannelCC(optarg, MAX_MASTERS - 1, &master, &chanCC)) {
+        port->masterCC[master] = chanCC;
+        g_mastersUsed |= 1 << master;
+        break;
+      }
+      error("Invalid master. Expects master=channel.cc, e.g. 0=16.7\n");
+      exit(1);
+    }
+    case 'S':
+      if (optarg && g_submasterRangeCount < MAX_RANGES) {
+        char *end;
+        long master = strtol(optarg, &end, 10);
+        if (end != optarg && *end == '=' && master >= 1 &&
+            master < MAX_MASTERS &&
+            parseSlotRange(end + 1, &g_submasterRanges[g_submasterRangeCount])) {
+          g_submasterIndex[g_submasterRangeCount++] = master;
+          break;
+        }
+      }
+      error("Invalid submaster. Expects master=universe[.first[-last]], e.g. "
+            "1=1.1-24\n");
+      exit(1);
+    case 'g':
+      if (parseGroup(optarg))
+        break;
+      error("Invalid group. Expects group=universe[.first[-last]][*scale],..."
+            ", e.g. 1=1.1-24,2.1-24*0.5\n");
+      exit(1);
+    case 'G': {
+      long group;
+      uint16_t chanCC;
+      if (parseChannelCC(optarg, MAX_GROUPS, &group, &chanCC) && group) {
+        port->groupCC[group - 1] = chanCC;
+        break;
+      }
+      error("Invalid group CC. Expects group=channel.cc, e.g. 1=16.20\n");
+      exit(1);
+    }
+    case 'e':
+      if (parseEffect(optarg))
+        break;
+      error("Invalid effect. Expects effect=group:shape[:period[:spread]], "
+            "e.g. 1=2:sine:2000:1\n");
+      exit(1);
+    case 'E':
+    case 'L':
+    case 'R': {
+      long effect;
+      uint16_t chanCC;
+      if (parseChannelCC(optarg, MAX_EFFECTS, &effect, &chanCC) && effect) {
+        if (opt == 'E')
+          port->effectNote[effect - 1] = chanCC;
+        else if (opt == 'L')
+          port->effectCC[effect - 1] = chanCC;
+        else
+          port->rateCC[effect - 1] = chanCC;
         break;
       }
-      error("Invalid universe. Must be number.\n");
+      error("Invalid effect %s. Expects effect=channel.%s, e.g. 1=16.60\n",
+            opt == 'E' ? "note" : "CC", opt == 'E' ? "note" : "cc");
       exit(1);
+    }
     case 'c':
       g_enableCC = true;
       break;
@@ -190,6 +1402,148 @@ void parseCommandLine(int argc, char *argv[]) {
         error("jackname must be less than 256 characters.\n");
         exit(1);
       }
+    case 'r':
+      if (optarg && (g_refreshRate = atoi(optarg)) > 0 && g_refreshRate <= 1000)
+        break;
+      error("Refresh rate must be in range 1..1000\n");
+      exit(1);
+    case 'T':
+      if (optarg && (g_threads = atoi(optarg)) > 0 && g_threads <= MAX_THREADS)
+        break;
+      error("Threads must be in range 1..%u\n", MAX_THREADS);
+      exit(1);
+    case 'B':
+      g_benchmark = true;
+      break;
+    case 'Y':
+      g_clockPort = port - g_ports;
+      break;
+    case 'w':
+      if (optarg && strlen(optarg) < sizeof(g_showPath)) {
+        strcpy(g_showPath, optarg);
+        break;
+      }
+      error("Invalid show file path\n");
+      exit(1);
+    case 'W':
+      g_mtcPort = port - g_ports;
+      break;
+    case 'X':
+      g_transport = true;
+      break;
+    case 'z':
+      if (optarg && strlen(optarg) < sizeof(g_recordPath)) {
+        strcpy(g_recordPath, optarg);
+        break;
+      }
+      error("Invalid record file path\n");
+      exit(1);
+    case 'd':
+      port->dump = true;
+      break;
+    case 'N':
+      if (parseEncoder(port, optarg))
+        break;
+      error("Invalid encoder %s. Expects channel.cc[-cc][:mode], e.g. "
+            "1.20-27:offset\n",
+            optarg ? optarg : "");
+      exit(1);
+    case 'i': {
+      char *end;
+      long rate = strtol(optarg, &end, 10);
+      if (end != optarg && !*end && rate > 0 && rate <= 10000) {
+        port->feedbackRate = rate;
+        break;
+      }
+      error("Feedback rate must be in range 1..10000 messages per second\n");
+      exit(1);
+    }
+    case 'l': {
+      char *end;
+      long latency = strtol(optarg, &end, 10);
+      if (end != optarg && !*end && latency >= 0 && latency <= 1000) {
+        g_fixtureLatency = latency;
+        g_align = true;
+        break;
+      }
+      error("Fixture latency must be in range 0..1000ms\n");
+      exit(1);
+    }
+    case 'q':
+      if (optarg && strlen(optarg) < sizeof(g_cuePath)) {
+        strcpy(g_cuePath, optarg);
+        break;
+      }
+      error("Invalid cue file path\n");
+      exit(1);
+    case 'Q': {
+      char *end;
+      long chan = strtol(optarg, &end, 10);
+      long go = -1, back = -1;
+      if (*end == '.') {
+        const char *start = end + 1;
+        go = strtol(start, &end, 10);
+        if (end == start)
+          go = -1;
+        if (*end == '.') {
+          start = end + 1;
+          back = strtol(start, &end, 10);
+          if (end == start)
+            back = 128;
+        }
+      }
+      if (!*end && chan >= 1 && chan <= 16 && go >= 0 && go <= 127 &&
+          back <= 127) {
+        port->cueGo = ((chan - 1) << 8) | go;
+        if (back >= 0)
+          port->cueBack = ((chan - 1) << 8) | back;
+        break;
+      }
+      error("Invalid cue notes. Expects channel.go[.back], e.g. 16.60.59\n");
+      exit(1);
+    }
+    case 'k': {
+      size_t len = strcspn(optarg, ":");
+      if (len < sizeof(g_scenePath)) {
+        memcpy(g_scenePath, optarg, len);
+        g_scenePath[len] = 0;
+        long count = optarg[len] ? atoi(optarg + len + 1) : DEFAULT_SCENES;
+        if (len && count >= 1 && count <= MAX_SCENES) {
+          g_newScenes = count;
+          break;
+        }
+      }
+      error("Invalid scene bank. Expects path[:scenes], scenes 1..%u\n",
+            MAX_SCENES);
+      exit(1);
+    }
+    case 'K': {
+      char *end;
+      long chan = strtol(optarg, &end, 10);
+      long note = 0xff;
+      if (*end == '.') {
+        const char *start = end + 1;
+        note = strtol(start, &end, 10);
+        if (end == start || note < 0 || note > 127)
+          note = -1;
+      }
+      if (!*end && chan >= 1 && chan <= 16 && note >= 0) {
+        port->sceneChannel = chan - 1;
+        port->captureNote = note;
+        break;
+      }
+      error("Invalid scene channel. Expects channel[.note], e.g. 15.0\n");
+      exit(1);
+    }
+    case 'P': {
+      long chan = atoi(optarg);
+      if (chan >= 1 && chan <= 16) {
+        port->cueChannel = chan - 1;
+        break;
+      }
+      error("Cue program change MIDI channel must be in range 1..16\n");
+      exit(1);
+    }
     case 'x':
       if (optarg) {
         long chan = atoi(optarg);
@@ -199,7 +1553,7 @@ void parseCommandLine(int argc, char *argv[]) {
         }
         uint16_t mask = 1 << (chan - 1);
         mask = ~mask;
-        g_midiChannels &= mask;
+        port->midiChannels &= mask;
       } else {
         error("Need to supply option to -x parameter\n");
       }
@@ -219,61 +1573,717 @@ void parseCommandLine(int argc, char *argv[]) {
   }
 }
 
-void cc7(uint8_t channel, uint8_t cc, uint8_t val) {
-  /*  @brief  Handle 7-bit (immediate) CC message
-      @param  channel MIDI channel [0..15]
-      @param  cc MIDI CC [0..127]
-      @param  val MIDI value [0..127]
-      @note   DMX Slots 1..128 populated by CC 0..127. Universe is MIDI channel
-     + universe base.
-      @note   DMX value is half resolution.
+uint16_t arenaIndex(uint16_t universe, const char *name) {
+  /*  @brief  Get arena index of a configured universe
+      @param  universe DMX universe
+      @param  name Name of configuration item, used in error message
+      @retval uint16_t Arena universe index
+      @note   Exits if universe is outside arena
   */
 
-  g_universe = channel + g_universeBase;
-  g_bufferIndex = channel;
-  val <<= 1;
-  g_dmxBuffer[g_bufferIndex].SetChannel(cc, val);
-  g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-  debug("Universe: %u slot %u value %u\n", g_universe, cc + 1, val);
+  uint32_t buffer = universe - g_arenaBase;
+  if (universe < g_arenaBase || buffer >= MAX_UNIVERSE) {
+    error("%s universe %u outside range %u..%u\n", name, universe,
+          g_arenaBase, g_arenaBase + MAX_UNIVERSE - 1);
+    exit(1);
+  }
+  return buffer;
 }
 
-void cc14(uint8_t channel, uint8_t cc, uint8_t val) {
-  /*  @brief  Handle 14-bit CC message
-      @param  channel MIDI channel [0..15]
-      @param  cc MIDI CC [0..127]
-      @param  val MIDI value [0..127]
-      @note   DMX Slots 1..32 populated by CC 0..31 (MSB) + 32..63 (LSB).
-      @note   Slot offset is MIDI channel * 32, e.g. MIDI channel 0:
-     slots 1..32, MIDI channel 1: slots 33..64.
-      @note   DMX value only set when LSB received.
+bool loadCurves() {
+  /*  @brief  Calculate response curve lookup tables
+      @retval bool True on success, false if a user lookup table failed to load
+      @note   A curve that fails to load is linear
   */
 
-  if (cc > 65)
-    return;
-
-  uint8_t offset = cc % 32;
-  uint8_t base = channel * 32;
-  g_slot = offset + base;
-  uint8_t curVal = g_dmxBuffer[g_bufferIndex].Get(g_slot);
-  if (cc > 31) {
-    // LSB
+  bool success = true;
+  for (uint16_t i = 0; i < 256; ++i)
+    g_curves[0][i] = i;
+  for (uint8_t index = 1; index < g_curveCount; ++index) {
+    Curve *curve = &g_curveDefs[index];
+    uint8_t *lut = g_curves[index];
+    for (uint16_t i = 0; i < 256; ++i) {
+      float x = i / 255.0;
+      switch (curve->type) {
+      case CURVE_GAMMA:
+        lut[i] = lroundf(255 * powf(x, curve->gamma));
+        break;
+      case CURVE_SCURVE:
+        lut[i] = lroundf(255 * x * x * (3 - 2 * x));
+        break;
+      case CURVE_INVERT:
+        lut[i] = 255 - i;
+        break;
+      default:
+        lut[i] = i;
+      }
+    }
+    if (curve->type != CURVE_FILE)
+      continue;
+    FILE *file = fopen(curve->path, "r");
+    uint16_t count = 0;
+    if (file) {
+      unsigned int val;
+      while (count < 256 && fscanf(file, "%u", &val) == 1 && val < 256)
+        lut[count++] = val;
+      fclose(file);
+    }
+    if (count < 256) {
+      error("Curve file %s must contain 256 values 0..255\n", curve->path);
+      for (uint16_t i = 0; i < 256; ++i)
+        lut[i] = i;
+      success = false;
+    }
+  }
+  return success;
+}
+
+void compileCue(Cue *cue, const CueChange *go, const CueChange *back) {
+  /*  @brief  Append changes of a cue to g_cueChanges
+      @param  cue Pointer to cue, with count of changes
+      @param  go Changes from previous cue, in order
+      @param  back Previous values of changed slots, in order
+      @note   BACK changes are stored reversed so a slot set more than once by
+     the cue is restored to its value before the cue
+  */
+
+  cue->changes = g_cueChangeCount;
+  if (!cue->count)
+    return;
+  g_cueChangeCount += cue->count * 2;
+  g_cueChanges = (CueChange *)realloc(g_cueChanges,
+                                      g_cueChangeCount * sizeof(CueChange));
+  CueChange *changes = g_cueChanges + cue->changes;
+  memcpy(changes, go, cue->count * sizeof(CueChange));
+  for (uint32_t i = 0; i < cue->count; ++i)
+    changes[cue->count + i] = back[cue->count - 1 - i];
+}
+
+bool loadCues() {
+  /*  @brief  Load cue stack from file and compile to lists of slot changes
+      @retval bool True on success
+      @note   File has a line "cue [fade ms]" to start each cue followed by
+     lines "universe[.first[-last]]=value". Values track (remain until changed
+     by a later cue). Text after # is ignored.
+      @note   Only slots that differ from the previous cue are stored
+  */
+
+  if (!g_cuePath[0])
+    return true;
+  FILE *file = fopen(g_cuePath, "r");
+  if (!file) {
+    error("Failed to open cue file %s\n", g_cuePath);
+    return false;
+  }
+  uint8_t(*look)[DMX_SLOTS] = // Slot values after each cue, tracked
+      (uint8_t(*)[DMX_SLOTS])calloc(MAX_UNIVERSE, DMX_SLOTS);
+  CueChange *go = NULL, *back = NULL; // Changes of cue being compiled
+  uint32_t capacity = 0, cueCapacity = 0;
+  char line[256];
+  uint32_t lineNumber = 0;
+  bool success = true;
+  while (fgets(line, sizeof(line), file)) {
+    ++lineNumber;
+    line[strcspn(line, "#\r\n")] = 0;
+    char *text = line + strspn(line, " \t");
+    if (!*text)
+      continue;
+    char *end;
+    if (strncmp(text, "cue", 3) == 0) {
+      long fade = strtol(text + 3, &end, 10);
+      if (end[strspn(end, " \t")] || fade < 0 || fade > 0xffff) {
+        success = false;
+        break;
+      }
+      if (g_cueCount)
+        compileCue(&g_cues[g_cueCount - 1], go, back);
+      if (g_cueCount >= cueCapacity) {
+        cueCapacity = cueCapacity ? cueCapacity * 2 : 64;
+        g_cues = (Cue *)realloc(g_cues, cueCapacity * sizeof(Cue));
+      }
+      g_cues[g_cueCount++] = {0, 0, (uint16_t)fade};
+      continue;
+    }
+    char *equals = strchr(text, '=');
+    if (!g_cueCount || !equals) {
+      success = false;
+      break;
+    }
+    *equals = 0;
+    long value = strtol(equals + 1, &end, 10);
+    SlotRange range;
+    if (end == equals + 1 || end[strspn(end, " \t")] || value < 0 ||
+        value > 255 || !parseSlotRange(text, &range)) {
+      success = false;
+      break;
+    }
+    uint16_t buffer = arenaIndex(range.universe, "Cue");
+    Cue *cue = &g_cues[g_cueCount - 1];
+    for (uint16_t slot = range.first; slot <= range.last; ++slot) {
+      if (look[buffer][slot] == value)
+        continue;
+      if (cue->count >= capacity) {
+        capacity = capacity ? capacity * 2 : 4096;
+        go = (CueChange *)realloc(go, capacity * sizeof(CueChange));
+        back = (CueChange *)realloc(back, capacity * sizeof(CueChange));
+      }
+      go[cue->count] = {buffer, slot, (uint8_t)value};
+      back[cue->count++] = {buffer, slot, look[buffer][slot]};
+      look[buffer][slot] = value;
+    }
+  }
+  if (success && g_cueCount)
+    compileCue(&g_cues[g_cueCount - 1], go, back);
+  if (!success)
+    error("Invalid cue file %s line %u\n", g_cuePath, lineNumber);
+  fclose(file);
+  free(look);
+  free(go);
+  free(back);
+  return success;
+}
+
+uint16_t portUniverses() {
+  /*  @brief  Get quantity of universes from arena base to last of all ports
+      @retval uint16_t Quantity of universes
+  */
+
+  uint16_t universes = 0;
+  for (uint8_t i = 0; i < g_portCount; ++i)
+    if (g_ports[i].bufferBase + g_ports[i].bufferCount > universes)
+      universes = g_ports[i].bufferBase + g_ports[i].bufferCount;
+  return universes;
+}
+
+bool loadScenes() {
+  /*  @brief  Map scene bank file into memory, creating it if it does not exist
+      @retval bool True on success
+      @note   A new bank holds g_newScenes scenes of the universes of all ports,
+     all slots 0
+  */
+
+  if (!g_scenePath[0])
+    return true;
+  int fd = open(g_scenePath, O_RDWR);
+  SceneHeader header = {"MIDIOLA", 1, g_arenaBase, 0, g_newScenes};
+  if (fd < 0) {
+    uint16_t universes = portUniverses();
+    header.universes = universes;
+    fd = open(g_scenePath, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+      error("Failed to create scene bank %s\n", g_scenePath);
+      return false;
+    }
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        ftruncate(fd, DMX_SLOTS + (size_t)universes * DMX_SLOTS *
+                                      header.scenes)) {
+      error("Failed to create scene bank %s\n", g_scenePath);
+      close(fd);
+      unlink(g_scenePath); // Do not leave a partial bank
+      return false;
+    }
+    info("Created scene bank %s\n", g_scenePath);
+  } else if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+             memcmp(header.magic, "MIDIOLA", sizeof(header.magic)) ||
+             header.version != 1) {
+    error("Invalid scene bank %s\n", g_scenePath);
+    close(fd);
+    return false;
+  }
+  if (header.universe < g_arenaBase ||
+      header.universe + header.universes > g_arenaBase + MAX_UNIVERSE) {
+    error("Scene bank universes %u..%u outside range %u..%u\n",
+          header.universe, header.universe + header.universes - 1,
+          g_arenaBase, g_arenaBase + MAX_UNIVERSE - 1);
+    close(fd);
+    return false;
+  }
+  g_sceneBankSize =
+      DMX_SLOTS + (size_t)header.universes * DMX_SLOTS * header.scenes;
+  struct stat st;
+  void *bank = MAP_FAILED;
+  if (!fstat(fd, &st) && (size_t)st.st_size >= g_sceneBankSize)
+    bank = mmap(NULL, g_sceneBankSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  close(fd);
+  if (bank == MAP_FAILED) {
+    error("Failed to map scene bank %s\n", g_scenePath);
+    return false;
+  }
+  g_sceneBank = (SceneHeader *)bank;
+  g_scenes = (uint8_t *)bank + DMX_SLOTS;
+  return true;
+}
+
+bool validShowIndex() {
+  /*  @brief  Check seek index read from show file
+      @retval bool True if each keyframe's record starts within the file and
+     keyframes are in ascending frame order within the show's frames
+  */
+
+  for (uint32_t i = 0; i < g_showHeader.keyframes; ++i) {
+    const ShowIndex *entry = &g_showIndex[i];
+    if (entry->offset < sizeof(ShowHeader) ||
+        entry->offset > g_showSize - sizeof(ShowRecord) ||
+        entry->frame >= g_showHeader.frames ||
+        (i && entry->frame <= g_showIndex[i - 1].frame))
+      return false;
+  }
+  return true;
+}
+
+bool loadShow() {
+  /*  @brief  Map show file into memory and read its seek index
+      @retval bool True on success
+      @note   If the file has no seek index (recording interrupted), it is
+     built by scanning the records
+  */
+
+  if (!g_showPath[0])
+    return true;
+  if ((g_mtcPort < 0) == !g_transport) {
+    error("Show playback requires either a port following MIDI Time Code "
+          "(-W) or JACK transport (-X)\n");
+    return false;
+  }
+  int fd = open(g_showPath, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(ShowHeader)) {
+    error("Failed to open show file %s\n", g_showPath);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  g_showSize = st.st_size;
+  void *show = mmap(NULL, g_showSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (show == MAP_FAILED) {
+    error("Failed to map show file %s\n", g_showPath);
+    return false;
+  }
+  g_show = (uint8_t *)show;
+  madvise(g_show, g_showSize, MADV_SEQUENTIAL);
+  memcpy(&g_showHeader, g_show, sizeof(ShowHeader));
+  ShowHeader *header = &g_showHeader;
+  size_t frameSize = (size_t)header->universes * DMX_SLOTS;
+  if (memcmp(header->magic, "MIDISHW", sizeof(header->magic)) ||
+      header->version != 1 || !header->rate) {
+    error("Invalid show file %s\n", g_showPath);
+    return false;
+  }
+  if (header->universe < g_arenaBase ||
+      header->universe + header->universes > g_arenaBase + MAX_UNIVERSE) {
+    error("Show universes %u..%u outside range %u..%u\n", header->universe,
+          header->universe + header->universes - 1, g_arenaBase,
+          g_arenaBase + MAX_UNIVERSE - 1);
+    return false;
+  }
+  if (header->index && header->index <= g_showSize &&
+      header->keyframes <= (g_showSize - header->index) / sizeof(ShowIndex)) {
+    g_showIndex = (ShowIndex *)malloc(header->keyframes * sizeof(ShowIndex));
+    memcpy(g_showIndex, g_show + header->index,
+           header->keyframes * sizeof(ShowIndex));
+    if (!validShowIndex()) {
+      error("Show file %s has invalid seek index\n", g_showPath);
+      free(g_showIndex);
+      g_showIndex = NULL;
+    }
+  }
+  if (!g_showIndex) {
+    // Scan records to count frames and index keyframes. Frame numbers
+    // increase but may skip frames dropped by the recorder.
+    uint32_t capacity = 0;
+    header->frames = 0;
+    header->keyframes = 0;
+    size_t offset = sizeof(ShowHeader);
+    ShowRecord record;
+    while (offset + sizeof(record) <= g_showSize) {
+      memcpy(&record, g_show + offset, sizeof(record));
+      if (record.frame < header->frames ||
+          offset + sizeof(record) + record.size > g_showSize)
+        break;
+      if (record.type == SHOW_KEYFRAME) {
+        if (header->keyframes >= capacity) {
+          capacity = capacity ? capacity * 2 : 1024;
+          g_showIndex = (ShowIndex *)realloc(g_showIndex,
+                                             capacity * sizeof(ShowIndex));
+        }
+        g_showIndex[header->keyframes++] = {record.frame, 0, offset};
+      }
+      header->frames = record.frame + 1;
+      offset += sizeof(record) + record.size;
+    }
+    info("Show file %s has no seek index, found %u frames\n", g_showPath,
+         header->frames);
+  }
+  if (!header->keyframes || g_showIndex[0].frame || !frameSize) {
+    error("Show file %s has no frames\n", g_showPath);
+    return false;
+  }
+  return true;
+}
+
+void updateScale(uint16_t buffer) {
+  /*  @brief  Calculate master scale of each slot of a universe
+      @param  buffer Arena universe index
+      @note   Grand master scales HTP (intensity) slots. Submasters scale their
+     slots.
+  */
+
+  uint16_t grand = g_masterLevel[0] + (g_masterLevel[0] >> 7); // [0..256]
+  for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot) {
+    uint16_t scale = 256;
+    if (g_htp[buffer][slot] && (g_mastersUsed & 1))
+      scale = grand;
+    uint8_t sub = g_slotMaster[buffer][slot];
+    if (sub)
+      scale = (scale * (g_masterLevel[sub] + (g_masterLevel[sub] >> 7))) >> 8;
+    g_scale[buffer][slot] = scale;
+  }
+}
+
+void configureMasters() {
+  /*  @brief  Assign slots to masters and calculate initial (full) scales
+      @note   Called after HTP slots are configured
+  */
+
+  memset(g_masterLevel, 255, sizeof(g_masterLevel));
+  for (uint16_t i = 0; i < g_submasterRangeCount; ++i) {
+    SlotRange *range = &g_submasterRanges[i];
+    uint16_t buffer = arenaIndex(range->universe, "Submaster");
+    memset(g_slotMaster[buffer] + range->first, g_submasterIndex[i],
+           range->last - range->first + 1);
+  }
+  for (uint16_t buffer = 0; buffer < MAX_UNIVERSE; ++buffer) {
+    uint64_t bit = 1ULL << (buffer % 64);
+    for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot) {
+      uint8_t master = g_slotMaster[buffer][slot];
+      if (master && (g_mastersUsed & (1 << master)))
+        g_masterUniverses[master][buffer / 64] |= bit;
+      if (g_htp[buffer][slot] && (g_mastersUsed & 1))
+        g_masterUniverses[0][buffer / 64] |= bit;
+    }
+    for (uint8_t master = 0; master < MAX_MASTERS; ++master)
+      g_mastered[buffer / 64] |= g_masterUniverses[master][buffer / 64] & bit;
+    if (g_mastered[buffer / 64] & bit)
+      updateScale(buffer);
+  }
+}
+
+void configureGroups() {
+  /*  @brief  Expand group slot ranges into lists of members for each group
+      @note   Members of group n are g_groupMembers[g_groupStart[n]] up to
+     g_groupMembers[g_groupStart[n + 1]]
+  */
+
+  uint16_t count = 0;
+  for (uint8_t group = 0; group < MAX_GROUPS; ++group) {
+    g_groupStart[group] = count;
+    for (uint16_t i = 0; i < g_groupRangeCount; ++i) {
+      GroupRange *groupRange = &g_groupRanges[i];
+      if (groupRange->group != group)
+        continue;
+      uint16_t buffer = arenaIndex(groupRange->range.universe, "Group");
+      for (uint16_t slot = groupRange->range.first;
+           slot <= groupRange->range.last; ++slot) {
+        if (count >= MAX_GROUP_MEMBERS) {
+          error("Maximum %u group members\n", MAX_GROUP_MEMBERS);
+          exit(1);
+        }
+        g_groupMembers[count++] = {buffer, slot, groupRange->scale};
+      }
+    }
+  }
+  g_groupStart[MAX_GROUPS] = count;
+}
+
+void updateStep(Effect *effect) {
+  /*  @brief  Calculate phase increment each refresh period from effect rate
+      @param  effect Pointer to effect
+      @note   Rate 64 runs at defined period, each 32 steps doubles or halves
+  */
+
+  double cycles = 1000.0 / ((double)effect->period * g_refreshRate) *
+                  exp2((effect->rate - 64) / 32.0);
+  if (cycles > 0.5)
+    cycles = 0.5; // Limit to Nyquist rate of refresh
+  effect->step = llround(cycles * 4294967296.0);
+}
+
+void configureEffects() {
+  /*  @brief  Calculate effect phase steps and universes and sine table
+      @note   Call after configureGroups
+  */
+
+  for (uint16_t i = 0; i < 256; ++i)
+    g_sine[i] = lround(127.5 - 127.5 * cos(2 * M_PI * i / 256));
+  for (uint8_t i = 0; i < MAX_EFFECTS; ++i) {
+    Effect *effect = &g_effects[i];
+    if (!effect->period)
+      continue;
+    uint16_t first = g_groupStart[effect->group];
+    uint16_t count = g_groupStart[effect->group + 1] - first;
+    if (count)
+      effect->spreadStep =
+          (uint64_t)llround(effect->spread * 4294967296.0 / count);
+    updateStep(effect);
+    for (uint16_t member = first; member < first + count; ++member) {
+      uint16_t buffer = g_groupMembers[member].buffer;
+      g_effectUniverses[i][buffer / 64] |= 1ULL << (buffer % 64);
+    }
+  }
+}
+
+void configurePorts() {
+  /*  @brief  Map each port's universe range into the universe arena
+      @note   Arena starts at lowest universe of all ports
+      @note   Ports may share (overlap) universes
+  */
+
+  g_arenaBase = 0xffff;
+  for (uint8_t i = 0; i < g_portCount; ++i)
+    if (g_ports[i].universeBase < g_arenaBase)
+      g_arenaBase = g_ports[i].universeBase;
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    MidiPort *port = &g_ports[i];
+    port->bufferBase = port->universeBase - g_arenaBase;
+    uint32_t count = port->universeLast - port->universeBase + 1;
+    if (port->bufferBase >= MAX_UNIVERSE) {
+      error("Port %s universe %u outside range %u..%u\n", port->name,
+            port->universeBase, g_arenaBase, g_arenaBase + MAX_UNIVERSE - 1);
+      exit(1);
+    }
+    if (count > (uint32_t)(MAX_UNIVERSE - port->bufferBase))
+      count = MAX_UNIVERSE - port->bufferBase;
+    port->bufferCount = count;
+    for (uint8_t master = 0; master < MAX_MASTERS; ++master)
+      if (port->masterCC[master] != 0xffff)
+        port->ccFunction[port->masterCC[master] >> 8]
+                        [port->masterCC[master] & 0x7f] =
+            (CC_FUNC_MASTER << 8) | master;
+    for (uint8_t group = 0; group < MAX_GROUPS; ++group)
+      if (port->groupCC[group] != 0xffff)
+        port->ccFunction[port->groupCC[group] >> 8]
+                        [port->groupCC[group] & 0x7f] =
+            (CC_FUNC_GROUP << 8) | group;
+    if (port->sceneChannel != 0xff) {
+      port->ccFunction[port->sceneChannel][0] = CC_FUNC_BANK << 8;
+      if (port->captureNote != 0xff)
+        port->noteFunction[port->sceneChannel][port->captureNote] =
+            CC_FUNC_CAPTURE << 8;
+    }
+    if (port->cueGo != 0xffff)
+      port->noteFunction[port->cueGo >> 8][port->cueGo & 0x7f] =
+          (CC_FUNC_CUE << 8) | CUE_GO;
+    if (port->cueBack != 0xffff)
+      port->noteFunction[port->cueBack >> 8][port->cueBack & 0x7f] =
+          (CC_FUNC_CUE << 8) | CUE_BACK;
+    for (uint8_t effect = 0; effect < MAX_EFFECTS; ++effect) {
+      if (port->effectNote[effect] != 0xffff)
+        port->noteFunction[port->effectNote[effect] >> 8]
+                          [port->effectNote[effect] & 0x7f] =
+            (CC_FUNC_EFFECT << 8) | effect;
+      if (port->effectCC[effect] != 0xffff)
+        port->ccFunction[port->effectCC[effect] >> 8]
+                        [port->effectCC[effect] & 0x7f] =
+            (CC_FUNC_EFFECT << 8) | effect;
+      if (port->rateCC[effect] != 0xffff)
+        port->ccFunction[port->rateCC[effect] >> 8]
+                        [port->rateCC[effect] & 0x7f] =
+            (CC_FUNC_RATE << 8) | effect;
+      if ((port->effectNote[effect] & port->effectCC[effect] &
+           port->rateCC[effect]) != 0xffff &&
+          !g_effects[effect].period) {
+        error("Effect %u controlled by port %s is not defined\n", effect + 1,
+              port->name);
+        exit(1);
+      }
+    }
+    for (uint8_t chan = 0; chan < 16; ++chan) {
+      port->state[chan].fadeTime = port->fadeTime;
+      if (port->fadeCC != 0xff)
+        port->ccFunction[chan][port->fadeCC] = CC_FUNC_FADE << 8;
+      if (port->bend[chan].enabled)
+        port->bend[chan].buffer =
+            arenaIndex(port->bend[chan].universe, "Pitch bend");
+      if (port->pressure[chan].enabled)
+        port->pressure[chan].buffer =
+            arenaIndex(port->pressure[chan].universe, "Pressure");
+    }
+  }
+  for (uint16_t i = 0; i < g_htpRangeCount; ++i) {
+    SlotRange *range = &g_htpRanges[i];
+    uint16_t buffer = arenaIndex(range->universe, "HTP");
+    memset(g_htp[buffer] + range->first, 0xff, range->last - range->first + 1);
+  }
+  for (uint16_t i = 0; i < g_curveRangeCount; ++i) {
+    SlotRange *range = &g_curveRanges[i].range;
+    uint16_t buffer = arenaIndex(range->universe, "Curve");
+    memset(g_curve[buffer] + range->first, g_curveRanges[i].curve,
+           range->last - range->first + 1);
+    if (g_curveRanges[i].curve)
+      g_curved[buffer / 64] |= 1ULL << (buffer % 64);
+  }
+  configureMasters();
+  configureGroups();
+  configureEffects();
+}
+
+inline void pushEvent(SlotEvent event) {
+  /*  @brief  Push slot change to event queue, counting overflow
+      @param  event Slot change
+      @note   Called from JACK process thread
+      @note   Stamped with output time of MIDI event being processed
+  */
+
+  event.due = g_eventDue;
+  if (!g_eventQueue.push(event))
+    g_eventOverflow.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void queueSlot(MidiPort *port, uint16_t index, uint16_t slot,
+                      uint8_t val, uint16_t fade) {
+  /*  @brief  Queue change of DMX slot value to output thread
+      @param  port Pointer to port that received the change
+      @param  index Universe offset from port's first universe
+      @param  slot DMX slot [0..511]
+      @param  val DMX value [0..255]
+      @param  fade Time to fade to new value in ms
+      @note   Called from JACK process thread
+      @note   Changes outside the port's universe range are ignored
+  */
+
+  if (index >= port->bufferCount)
+    return;
+  pushEvent({(uint16_t)(port->bufferBase + index), slot, val, fade,
+             (uint8_t)(port - g_ports), 0});
+}
+
+inline void queueSlot16(MidiPort *port, uint16_t index, uint16_t slot,
+                        uint16_t val) {
+  /*  @brief  Queue change of 16-bit coarse/fine DMX slot pair to output thread
+      @param  port Pointer to port that received the change
+      @param  index Universe offset from port's first universe
+      @param  slot Coarse DMX slot [0..510]. Fine slot is following slot.
+      @param  val 16-bit DMX value [0..65535]
+      @note   Called from JACK process thread
+      @note   Both slots are carried by one event so are always sent together
+      @note   16-bit changes do not fade (coarse and fine would fade apart)
+  */
+
+  if (index >= port->bufferCount || slot >= DMX_SLOTS - 1)
+    return;
+  pushEvent({(uint16_t)(port->bufferBase + index), slot, val, 0,
+             (uint8_t)(port - g_ports), EVENT_FLAG_16BIT});
+}
+
+inline void queueTarget(MidiPort *port, const SlotTarget *target,
+                        uint16_t val, uint16_t fade) {
+  /*  @brief  Queue change of mapped slot (or coarse/fine slot pair)
+      @param  port Pointer to port that received the change
+      @param  target Pointer to mapped slot
+      @param  val 16-bit value [0..65535], reduced to 8-bit for single slot
+      @param  fade Time to fade to new value in ms (single slot only)
+      @note   Called from JACK process thread
+  */
+
+  if (target->wide)
+    pushEvent({target->buffer, target->slot, val, 0,
+               (uint8_t)(port - g_ports), EVENT_FLAG_16BIT});
+  else
+    pushEvent({target->buffer, target->slot, (uint16_t)(val >> 8), fade,
+               (uint8_t)(port - g_ports), 0});
+}
+
+inline uint16_t scale14to16(uint16_t val) {
+  /*  @brief  Scale 14-bit MIDI value to full 16-bit range
+      @param  val 14-bit value [0..16383]
+      @retval uint16_t 16-bit value [0..65535]
+  */
+
+  return (val << 2) | (val >> 12);
+}
+
+void cc7(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
+  /*  @brief  Handle 7-bit (immediate) CC message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  val MIDI value [0..127]
+      @note   DMX Slots 1..128 populated by CC 0..127. Universe is MIDI channel
+     + universe base.
+      @note   DMX value is half resolution.
+  */
+
+  val <<= 1;
+  queueSlot(port, channel, cc, val, port->state[channel].fadeTime);
+  debug("Universe: %u slot %u value %u\n", port->universeBase + channel,
+        cc + 1, val);
+}
+
+void cc14(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
+  /*  @brief  Handle 14-bit CC message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  val MIDI value [0..127]
+      @note   DMX Slots 1..32 populated by CC 0..31 (MSB) + 32..63 (LSB).
+      @note   Universe is MIDI channel + universe base.
+      @note   DMX value only set when LSB received.
+  */
+
+  if (cc > 63)
+    return;
+
+  uint8_t slot = cc % 32;
+  uint8_t curVal = port->state[channel].cc14Val[slot];
+  if (cc > 31) {
+    // LSB
     if (val > 63)
       curVal |= 0x01;
     else
       curVal &= 0xfe;
-    g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, curVal);
-    g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
+    queueSlot(port, channel, slot, curVal, port->state[channel].fadeTime);
   } else {
     // MSB
     curVal &= 0x01;
     curVal |= (val << 1);
-    g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, curVal);
   }
-  debug("Universe: %u slot %u value %u\n", g_universe, g_slot + 1, curVal);
+  port->state[channel].cc14Val[slot] = curVal;
+  debug("Universe: %u slot %u value %u\n", port->universeBase + channel,
+        slot + 1, curVal);
+}
+
+void selectNrpn(MidiPort *port, uint8_t channel) {
+  /*  @brief  Select DMX universe and slot from current NRPN parameter
+      @param  port Pointer to port that received the NRPN
+      @param  channel MIDI channel [0..15]
+  */
+
+  ChannelState *state = &port->state[channel];
+  state->slot = state->nrpnParam % 512;
+  state->bufferIndex = channel * 32 + state->nrpnParam / 512;
+  debug("NRPN param: %u universe: %u slot: %u\n", state->nrpnParam,
+        port->universeBase + state->bufferIndex, state->slot + 1);
 }
 
-void nrpnCC7(uint8_t channel, uint8_t cc, uint8_t val) {
+inline void nextNrpn(MidiPort *port, uint8_t channel, uint8_t slots) {
+  /*  @brief  Advance NRPN parameter after data entry, if port auto-increments
+      @param  port Pointer to port that received the data entry
+      @param  channel MIDI channel [0..15]
+      @param  slots Quantity of slots set by the data entry
+  */
+
+  ChannelState *state = &port->state[channel];
+  if (!port->nrpnIncrement || state->nrpnParam + slots > 0x3fff)
+    return;
+  state->nrpnParam += slots;
+  selectNrpn(port, channel);
+}
+
+void nrpnCC7(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
   /*  @brief  Handle NRPN 7-bit CC message
+      @param  port Pointer to port that received the message
       @param  channel MIDI channel [0..15]
       @param  cc MIDI CC [0..127]
       @param  val MIDI value [0..127]
@@ -285,52 +2295,49 @@ void nrpnCC7(uint8_t channel, uint8_t cc, uint8_t val) {
       @note   Maximum 512 universes.
   */
 
+  ChannelState *state = &port->state[channel];
   switch (cc) {
   case MIDI_CMD_NRPN_LSB:
-    g_nrpnParam = (g_nrpnParam & 0x3f80) | val;
-    g_slot = g_nrpnParam % 512;
-    g_bufferIndex = g_nrpnParam / 512;
-    g_universe = g_bufferIndex + g_universeBase;
-    debug("NRPN param: %u universe: %u slot: %u\n", g_nrpnParam, g_universe,
-          g_slot + 1);
+    state->nrpnParam = (state->nrpnParam & 0x3f80) | val;
+    selectNrpn(port, channel);
     break;
   case MIDI_CMD_NRPN_MSB:
-    g_nrpnParam = (g_nrpnParam & 0x7f) | (val << 7);
-    g_slot = g_nrpnParam % 512;
-    g_bufferIndex = g_nrpnParam / 512;
-    g_universe = g_bufferIndex + g_universeBase;
-    debug("NRPN param: %u universe: %u slot: %u\n", g_nrpnParam, g_universe,
-          g_slot + 1);
+    state->nrpnParam = (state->nrpnParam & 0x7f) | (val << 7);
+    selectNrpn(port, channel);
     break;
   case MIDI_CMD_DATA_MSB:
-    g_nrpnVal = val << 1;
-    g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, g_nrpnVal);
-    g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-    debug("NRPN param: %u universe: %u slot: %u val: %u\n", g_nrpnParam,
-          g_universe, g_slot + 1, g_nrpnVal);
+    state->nrpnVal = val << 1;
+    queueSlot(port, state->bufferIndex, state->slot, state->nrpnVal,
+              state->fadeTime);
+    debug("NRPN param: %u universe: %u slot: %u val: %u\n", state->nrpnParam,
+          port->universeBase + state->bufferIndex, state->slot + 1,
+          state->nrpnVal);
+    nextNrpn(port, channel, 1);
     break;
   case MIDI_CMD_INC:
-    if (g_nrpnVal < 255) {
-      g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, ++g_nrpnVal);
-      g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-      debug("NRPN param: %u universe: %u slot: %u val: %u\n", g_nrpnParam,
-            g_universe, g_slot + 1, g_nrpnVal);
+    if (state->nrpnVal < 255) {
+      queueSlot(port, state->bufferIndex, state->slot, ++state->nrpnVal,
+                state->fadeTime);
+      debug("NRPN param: %u universe: %u slot: %u val: %u\n", state->nrpnParam,
+            port->universeBase + state->bufferIndex, state->slot + 1,
+            state->nrpnVal);
     }
     break;
   case MIDI_CMD_DEC:
-    g_slot = g_nrpnParam % 512;
-    if (g_nrpnVal > 0) {
-      g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, --g_nrpnVal);
-      g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-      debug("NRPN param: %u universe: %u slot: %u val: %u\n", g_nrpnParam,
-            g_universe, g_slot + 1, g_nrpnVal);
+    if (state->nrpnVal > 0) {
+      queueSlot(port, state->bufferIndex, state->slot, --state->nrpnVal,
+                state->fadeTime);
+      debug("NRPN param: %u universe: %u slot: %u val: %u\n", state->nrpnParam,
+            port->universeBase + state->bufferIndex, state->slot + 1,
+            state->nrpnVal);
     }
     break;
   }
 }
 
-void nrpnCC14(uint8_t channel, uint8_t cc, uint8_t val) {
+void nrpnCC14(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
   /*  @brief  Handle NRPN 14-bit CC message
+      @param  port Pointer to port that received the message
       @param  channel MIDI channel [0..15]
       @param  cc MIDI CC [0..127]
       @param  val MIDI value [0..127]
@@ -338,169 +2345,2301 @@ void nrpnCC14(uint8_t channel, uint8_t cc, uint8_t val) {
       @note   DMX Universe 1, slots 1..512 populated by NRPN parameters
      512..1023.
       @note   DMX value only sent after LSB received.
-      @note   Maximum 32 universes.
+      @note   MIDI channel offsets universe (x32). Maximum 512 universes.
   */
 
+  ChannelState *state = &port->state[channel];
   switch (cc) {
   case MIDI_CMD_NRPN_LSB:
-    g_nrpnParam = (g_nrpnParam & 0x3f80) | val;
-    g_slot = g_nrpnParam % 512;
-    g_bufferIndex = g_nrpnParam / 512;
-    g_universe = g_bufferIndex + g_universeBase;
-    debug("NRPN param: %u universe: %u slot: %u\n", g_nrpnParam, g_universe,
-          g_slot + 1);
+    state->nrpnParam = (state->nrpnParam & 0x3f80) | val;
+    selectNrpn(port, channel);
     break;
   case MIDI_CMD_NRPN_MSB:
-    g_nrpnParam = (g_nrpnParam & 0x7f) | (val << 7);
-    g_slot = g_nrpnParam % 512;
-    g_bufferIndex = g_nrpnParam / 512;
-    g_universe = g_bufferIndex + g_universeBase;
-    debug("NRPN param: %u universe: %u slot: %u\n", g_nrpnParam, g_universe,
-          g_slot + 1);
+    state->nrpnParam = (state->nrpnParam & 0x7f) | (val << 7);
+    selectNrpn(port, channel);
     break;
   case MIDI_CMD_DATA_MSB:
-    g_nrpnVal = (g_nrpnVal & 0x01) | (val << 1);
-    debug("NRPN param: %u val: %u\n", g_nrpnParam, g_nrpnVal);
+    state->nrpnVal = (state->nrpnVal & 0x01) | (val << 1);
+    debug("NRPN param: %u val: %u\n", state->nrpnParam, state->nrpnVal);
     break;
   case MIDI_CMD_DATA_LSB:
     if (val > 63)
-      g_nrpnVal |= 0x01;
+      state->nrpnVal |= 0x01;
     else
-      g_nrpnVal &= 0xfe;
-    g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, g_nrpnVal);
-    g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-    debug("NRPN param: %u universe: %u slot: %u val: %u\n", g_nrpnParam,
-          g_universe, g_slot + 1, g_nrpnVal);
+      state->nrpnVal &= 0xfe;
+    queueSlot(port, state->bufferIndex, state->slot, state->nrpnVal,
+              state->fadeTime);
+    debug("NRPN param: %u universe: %u slot: %u val: %u\n", state->nrpnParam,
+          port->universeBase + state->bufferIndex, state->slot + 1,
+          state->nrpnVal);
+    nextNrpn(port, channel, 1);
     break;
   case MIDI_CMD_INC:
-    if (g_nrpnVal < 255) {
-      g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, ++g_nrpnVal);
-      g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-      debug("NRPN param: %u slot: %u val: %u\n", g_nrpnParam, g_slot + 1,
-            g_nrpnVal);
+    if (state->nrpnVal < 255) {
+      queueSlot(port, state->bufferIndex, state->slot, ++state->nrpnVal,
+                state->fadeTime);
+      debug("NRPN param: %u slot: %u val: %u\n", state->nrpnParam,
+            state->slot + 1, state->nrpnVal);
     }
     break;
   case MIDI_CMD_DEC:
-    if (g_nrpnVal > 0) {
-      g_dmxBuffer[g_bufferIndex].SetChannel(g_slot, --g_nrpnVal);
-      g_olaClient->SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-      debug("NRPN param: %u slot: %u val: %u\n", g_nrpnParam, g_slot + 1,
-            g_nrpnVal);
+    if (state->nrpnVal > 0) {
+      queueSlot(port, state->bufferIndex, state->slot, --state->nrpnVal,
+                state->fadeTime);
+      debug("NRPN param: %u slot: %u val: %u\n", state->nrpnParam,
+            state->slot + 1, state->nrpnVal);
     }
     break;
   }
 }
 
-int onJackProcess(jack_nframes_t frames, void *args) {
-  // Process MIDI input
-  uint8_t cmd, chan, cc, val;
-  void *midiBuffer = jack_port_get_buffer(g_midiInputPort, frames);
-  jack_midi_event_t midiEvent;
-  jack_nframes_t count = jack_midi_get_event_count(midiBuffer);
-  for (jack_nframes_t eventIndex = 0; eventIndex < count; ++eventIndex) {
-    if (jack_midi_event_get(&midiEvent, midiBuffer, eventIndex))
-      continue;
-    cmd = midiEvent.buffer[0] & 0xf0;
-    // debug("Rx MIDI event %u/%u: %02x\n", eventIndex + 1, count, cmd);
-    if (g_enableCC && cmd == 0xb0) {
-      // MIDI CC
-      chan = midiEvent.buffer[0] & 0x0f;
-      if (((1 << chan) & g_midiChannels) == 0)
-        continue;
-      cc = midiEvent.buffer[1];
-      val = midiEvent.buffer[2];
-      switch (g_mode) {
-      case MIDI_MODE_CC7:
-        cc7(chan, cc, val);
-        break;
-      case MIDI_MODE_CC14:
-        cc14(chan, cc, val);
-        break;
-      case MIDI_MODE_NRPN7:
-        nrpnCC7(chan, cc, val);
-        break;
-      case MIDI_MODE_NRPN14:
-        nrpnCC14(chan, cc, val);
-        break;
-      }
-    } else if (g_enableNoteOff && (cmd == 0x80)) {
-      // MIDI Note-off
-      chan = midiEvent.buffer[0] & 0x0f;
-      if (((1 << chan) & g_midiChannels) == 0)
-        continue;
-      cc = midiEvent.buffer[1];
-      cc7(chan, cc, 0);
-    } else if (g_enableNote && (cmd == 0x90)) {
-      // MIDI Note-on
-      chan = midiEvent.buffer[0] & 0x0f;
-      if (((1 << chan) & g_midiChannels) == 0)
-        continue;
-      cc = midiEvent.buffer[1];
-      val = midiEvent.buffer[2];
-      cc7(chan, cc, val);
-    }
+void cc16(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
+  /*  @brief  Handle 16-bit coarse/fine CC message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  val MIDI value [0..127]
+      @note   DMX Slot pairs 1+2..63+64 populated by CC 0..31 (MSB) + 32..63
+     (LSB).
+      @note   Universe is MIDI channel + universe base.
+      @note   DMX values only set when LSB received.
+  */
+
+  if (cc > 63)
+    return;
+
+  ChannelState *state = &port->state[channel];
+  uint8_t index = cc % 32;
+  if (cc < 32) {
+    state->ccMsb[index] = val;
+    return;
   }
-  return 0;
+  uint16_t val16 = scale14to16((state->ccMsb[index] << 7) | val);
+  queueSlot16(port, channel, index * 2, val16);
+  debug("Universe: %u slots %u+%u value %u\n", port->universeBase + channel,
+        index * 2 + 1, index * 2 + 2, val16);
 }
 
-int main(int argc, char *argv[]) {
-  strcpy(g_jackname, "jackmidiola");
-  parseCommandLine(argc, argv);
-  if (!g_enableNote && !g_enableCC)
-    g_enableCC = true;
+void nrpnCC16(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t val) {
+  /*  @brief  Handle NRPN 16-bit coarse/fine CC message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  val MIDI value [0..127]
+      @note   NRPN parameter selects coarse slot as nrpn14. Fine slot is the
+     following slot.
+      @note   DMX values only sent after LSB received.
+      @note   Increment / decrement adjust by one 14-bit step.
+  */
 
-  info("Starting jackmidiola - JACK MIDI to Openlighting interface\n");
-  info("  Mode: %s\n", modeNames[g_mode]);
-  info("  First universe: %u\n", g_universeBase);
-  info("  Enabled MIDI channels: ");
-  bool comma = false;
-  for (uint8_t chan = 0; chan < 16; ++chan) {
-    if ((1 << chan) & g_midiChannels) {
-      if (comma)
-        info(", %u", chan + 1);
-      else {
-        info("%u", chan + 1);
-        comma = true;
-      }
-    }
+  ChannelState *state = &port->state[channel];
+  switch (cc) {
+  case MIDI_CMD_NRPN_LSB:
+    state->nrpnParam = (state->nrpnParam & 0x3f80) | val;
+    selectNrpn(port, channel);
+    return;
+  case MIDI_CMD_NRPN_MSB:
+    state->nrpnParam = (state->nrpnParam & 0x7f) | (val << 7);
+    selectNrpn(port, channel);
+    return;
+  case MIDI_CMD_DATA_MSB:
+    state->nrpnVal14 = (state->nrpnVal14 & 0x7f) | (val << 7);
+    return;
+  case MIDI_CMD_DATA_LSB:
+    state->nrpnVal14 = (state->nrpnVal14 & 0x3f80) | val;
+    break;
+  case MIDI_CMD_INC:
+    if (state->nrpnVal14 == 0x3fff)
+      return;
+    ++state->nrpnVal14;
+    break;
+  case MIDI_CMD_DEC:
+    if (state->nrpnVal14 == 0)
+      return;
+    --state->nrpnVal14;
+    break;
+  default:
+    return;
   }
-  info("\n");
-  debug("  Debug enabled\n");
+  uint16_t val16 = scale14to16(state->nrpnVal14);
+  queueSlot16(port, state->bufferIndex, state->slot, val16);
+  debug("NRPN param: %u universe: %u slots: %u+%u val: %u\n",
+        state->nrpnParam, port->universeBase + state->bufferIndex,
+        state->slot + 1, state->slot + 2, val16);
+  if (cc == MIDI_CMD_DATA_LSB)
+    nextNrpn(port, channel, 2);
+}
 
-  // Create a OLA client.
-  ola::client::StreamingClient olaClient(
-      (ola::client::StreamingClient::Options()));
-  g_olaClient = &olaClient;
+void pitchBend(MidiPort *port, uint8_t channel, uint8_t lsb, uint8_t msb) {
+  /*  @brief  Handle pitch bend message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  lsb Least significant 7 bits of bend [0..127]
+      @param  msb Most significant 7 bits of bend [0..127]
+      @note   14-bit bend scaled to mapped slot or coarse/fine slot pair
+  */
 
-  // Setup OLA, connect to the server
-  if (!olaClient.Setup()) {
-    error("Failed to setup OLA client. Is olad running?\n");
-    exit(1);
-  }
-  // Initalise buffers and send to universe
-  debug("Initalising DMX buffers\n");
-  for (uint8_t universe = 0; universe < MAX_MIDI_UNIVERSE; ++universe) {
-    g_dmxBuffer[g_bufferIndex].Blackout();
-    olaClient.SendDmx(g_universe, g_dmxBuffer[g_bufferIndex]);
-  }
+  const SlotTarget *target = &port->bend[channel];
+  if (!target->enabled)
+    return;
+  uint16_t val16 = scale14to16((msb << 7) | lsb);
+  queueTarget(port, target, val16, port->state[channel].fadeTime);
+  debug("Pitch bend universe: %u slot: %u val: %u\n", target->universe,
+        target->slot + 1, target->wide ? val16 : val16 >> 8);
+}
 
-  // Create JACK client
-  char *serverName = NULL;
-  jack_status_t jackStatus;
-  if ((g_jackClient = jack_client_open(g_jackname, JackNoStartServer,
-                                       &jackStatus, serverName)) == 0) {
-    error("Failed to start jack client: %d. Is jackd running?\n", jackStatus);
-    exit(1);
-  }
-  // Create MIDI input port
-  if (!(g_midiInputPort =
-            jack_port_register(g_jackClient, "input", JACK_DEFAULT_MIDI_TYPE,
-                               JackPortIsInput | JackPortIsPhysical, 0))) {
-    error("Cannot register jack input port\n");
-    exit(1);
+void channelPressure(MidiPort *port, uint8_t channel, uint8_t val) {
+  /*  @brief  Handle channel pressure (aftertouch) message
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  val Pressure [0..127]
+      @note   7-bit pressure scaled to mapped slot or coarse/fine slot pair
+  */
+
+  const SlotTarget *target = &port->pressure[channel];
+  if (!target->enabled)
+    return;
+  uint16_t val16 = scale14to16((val << 7) | val);
+  queueTarget(port, target, val16, port->state[channel].fadeTime);
+  debug("Pressure universe: %u slot: %u val: %u\n", target->universe,
+        target->slot + 1, target->wide ? val16 : val16 >> 8);
+}
+
+void noteFade(MidiPort *port, uint8_t channel, uint8_t note, uint8_t vel) {
+  /*  @brief  Handle note-on that fades slot to full
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  note MIDI note [0..127]
+      @param  vel MIDI velocity [1..127] sets fade time, 100ms per step
+      @note   Slot as cc7 mode. Note-off fades with channel fade time.
+  */
+
+  queueSlot(port, channel, note, 255, vel * 100);
+  debug("Universe: %u slot %u fade to full in %ums\n",
+        port->universeBase + channel, note + 1, vel * 100);
+}
+
+void encoderCC(MidiPort *port, uint8_t channel, uint8_t cc, uint8_t mode,
+               uint8_t val, jack_nframes_t frame) {
+  /*  @brief  Handle relative CC message from endless encoder
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  mode Relative value encoding (ENCODER_MODE)
+      @param  val MIDI value [0..127]
+      @param  frame JACK frame of message
+      @note   Called from JACK process thread
+      @note   Adjusts slot that the CC sets in cc7, cc14 and cc16 modes (MSB
+     CC) or the selected NRPN slot in NRPN modes. Steps are 1 of 255, or 1 of
+     1024 for 16-bit slot pairs.
+      @note   Step is multiplied by the rate of messages from the encoder, up
+     to ENCODER_MAX_ACCEL, so a fast turn covers the range in a few messages
+  */
+
+  int8_t delta;
+  if (mode == ENCODER_TWOS)
+    delta = val < 64 ? val : val - 128;
+  else if (mode == ENCODER_OFFSET)
+    delta = val - 64;
+  else
+    delta = val & 0x40 ? -(val & 0x3f) : val & 0x3f;
+  if (!delta)
+    return;
+  ChannelState *state = &port->state[channel];
+  jack_nframes_t interval = frame - state->encoderFrame[cc];
+  state->encoderFrame[cc] = frame;
+  jack_nframes_t slow = jack_get_sample_rate(g_jackClient) / ENCODER_SLOW_RATE;
+  uint32_t accel = ENCODER_MAX_ACCEL;
+  if (interval > slow / ENCODER_MAX_ACCEL)
+    accel = slow / interval;
+  int32_t step = delta * (int32_t)(accel ? accel : 1);
+  int32_t val32 = 0;
+  switch (port->mode[channel]) {
+  case MIDI_MODE_CC7:
+  case MIDI_MODE_CC14:
+    if (port->mode[channel] == MIDI_MODE_CC14 && cc > 31)
+      return;
+    val32 = state->encoderVal[cc] + step;
+    val32 = val32 < 0 ? 0 : val32 > 255 ? 255 : val32;
+    state->encoderVal[cc] = val32;
+    if (port->mode[channel] == MIDI_MODE_CC14)
+      state->cc14Val[cc] = val32; // Absolute LSB continues from this value
+    queueSlot(port, channel, cc, val32, state->fadeTime);
+    break;
+  case MIDI_MODE_CC16:
+    if (cc > 31)
+      return;
+    val32 = state->encoderVal[cc] + step * 64;
+    val32 = val32 < 0 ? 0 : val32 > 0xffff ? 0xffff : val32;
+    state->encoderVal[cc] = val32;
+    queueSlot16(port, channel, cc * 2, val32);
+    break;
+  case MIDI_MODE_NRPN7:
+  case MIDI_MODE_NRPN14:
+    val32 = state->nrpnVal + step;
+    state->nrpnVal = val32 < 0 ? 0 : val32 > 255 ? 255 : val32;
+    queueSlot(port, state->bufferIndex, state->slot, state->nrpnVal,
+              state->fadeTime);
+    val32 = state->nrpnVal;
+    break;
+  case MIDI_MODE_NRPN16:
+    val32 = state->nrpnVal14 + step * 16;
+    state->nrpnVal14 = val32 < 0 ? 0 : val32 > 0x3fff ? 0x3fff : val32;
+    queueSlot16(port, state->bufferIndex, state->slot,
+                scale14to16(state->nrpnVal14));
+    val32 = state->nrpnVal14;
+    break;
+  }
+  debug("Encoder channel %u CC %u step %d value %d\n", channel + 1, cc, step,
+        val32);
+}
+
+void ccFunction(MidiPort *port, uint8_t channel, uint16_t function,
+                uint8_t val) {
+  /*  @brief  Handle CC or note assigned to a function rather than a slot
+      @param  port Pointer to port that received the message
+      @param  channel MIDI channel [0..15]
+      @param  function CC_FUNCTION << 8 | index
+      @param  val MIDI value [0..127]
+  */
+
+  uint8_t index = function & 0xff;
+  switch (function >> 8) {
+  case CC_FUNC_FADE:
+    port->state[channel].fadeTime = val * 100;
+    break;
+  case CC_FUNC_GROUP:
+    pushEvent({0, index, (uint16_t)((val << 1) | (val >> 6)),
+               port->state[channel].fadeTime, (uint8_t)(port - g_ports),
+               EVENT_FLAG_GROUP});
+    debug("Group %u level %u\n", index + 1, (val << 1) | (val >> 6));
+    break;
+  case CC_FUNC_EFFECT:
+    pushEvent({0, index, (uint16_t)((val << 1) | (val >> 6)), 0,
+               (uint8_t)(port - g_ports), EVENT_FLAG_EFFECT});
+    debug("Effect %u level %u\n", index + 1, (val << 1) | (val >> 6));
+    break;
+  case CC_FUNC_RATE:
+    pushEvent({0, index, val, 0, (uint8_t)(port - g_ports), EVENT_FLAG_RATE});
+    debug("Effect %u rate %u\n", index + 1, val);
+    break;
+  case CC_FUNC_CUE:
+    if (val)
+      pushEvent({0, index, 0, 0, (uint8_t)(port - g_ports), EVENT_FLAG_CUE});
+    break;
+  case CC_FUNC_BANK:
+    port->sceneBank = val;
+    break;
+  case CC_FUNC_CAPTURE:
+    if (val)
+      pushEvent({0, SCENE_CAPTURE, 0, 0, (uint8_t)(port - g_ports),
+                 EVENT_FLAG_SCENE});
+    break;
+  case CC_FUNC_MASTER:
+    pushEvent({0, index, (uint16_t)((val << 1) | (val >> 6)), 0,
+               (uint8_t)(port - g_ports), EVENT_FLAG_MASTER});
+    debug("Master %u level %u\n", index, (val << 1) | (val >> 6));
+    break;
+  }
+}
+
+void configureDecoders() {
+  /*  @brief  Populate each port's CC decoder table from its channel modes
+      @note   Decoder is selected once here so process thread need not test mode
+  */
+
+  const CcHandler handlers[] = {cc7, cc14, nrpnCC7, nrpnCC14, cc16, nrpnCC16};
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    MidiPort *port = &g_ports[i];
+    for (uint8_t chan = 0; chan < 16; ++chan)
+      port->ccHandler[chan] = handlers[port->mode[chan]];
+  }
+}
+
+void publishClock(bool running) {
+  /*  @brief  Publish MIDI clock state to output thread
+      @param  running True if clock is running
+      @note   Called from JACK process thread
+      @note   Sequence lock: reader retries if sequence is odd or changes
+  */
+
+  uint32_t sequence = g_clock.sequence.load(std::memory_order_relaxed);
+  g_clock.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  g_clock.ticks.store(g_clockTicks, std::memory_order_relaxed);
+  g_clock.frame.store(g_clockFrame, std::memory_order_relaxed);
+  g_clock.interval.store(g_clockInterval, std::memory_order_relaxed);
+  g_clock.running.store(running, std::memory_order_relaxed);
+  g_clock.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void clockMessage(const uint8_t *msg, size_t size, jack_nframes_t frame) {
+  /*  @brief  Handle MIDI clock, start, continue, stop and song position
+      @param  msg MIDI message
+      @param  size Quantity of bytes in message
+      @param  frame JACK frame of message
+      @note   Called from JACK process thread
+      @note   Clock interval is filtered: intervals within 50% of estimate
+     move it 1/16 of the difference (smoothing jitter). 3 consecutive
+     intervals outside that reset the estimate (tempo jump).
+  */
+
+  switch (msg[0]) {
+  case 0xf8: { // Clock
+    uint32_t interval = frame - g_clockFrame;
+    if (g_clockTicks >= 0 && interval) {
+      if (g_clockInterval == 0) {
+        g_clockInterval = interval;
+      } else if (fabsf(interval - g_clockInterval) < g_clockInterval * 0.5f) {
+        g_clockInterval += (interval - g_clockInterval) * 0.0625f;
+        g_clockOutliers = 0;
+      } else if (++g_clockOutliers >= 3) {
+        g_clockInterval = interval;
+        g_clockOutliers = 0;
+      }
+    }
+    g_clockFrame = frame;
+    ++g_clockTicks;
+    publishClock(g_clock.running.load(std::memory_order_relaxed));
+    break;
+  }
+  case 0xfa: // Start
+    g_clockTicks = -1;
+    publishClock(true);
+    break;
+  case 0xfb: // Continue
+    publishClock(true);
+    break;
+  case 0xfc: // Stop
+    publishClock(false);
+    break;
+  case 0xf2: // Song position pointer (16ths), next clock is at position
+    if (size < 3)
+      break;
+    g_clockTicks = (msg[1] | (msg[2] << 7)) * 6 - 1;
+    publishClock(g_clock.running.load(std::memory_order_relaxed));
+    break;
+  }
+}
+
+void publishPosition(uint32_t ms, jack_nframes_t frame, bool running) {
+  /*  @brief  Publish show position (MIDI Time Code or JACK transport) to
+     output thread
+      @param  ms Position in ms
+      @param  frame JACK frame at which show was at that position
+      @param  running True if position is advancing (quarter frames, rolling)
+      @note   Called from JACK process thread
+  */
+
+  g_showPosition.store(((uint64_t)running << 63) | (1ULL << 62) |
+                  ((uint64_t)(ms & 0x3fffffff) << 32) | frame,
+              std::memory_order_release);
+}
+
+void mtcMessage(const uint8_t *msg, size_t size, jack_nframes_t frame) {
+  /*  @brief  Handle MIDI Time Code quarter frame and full frame messages
+      @param  msg MIDI message
+      @param  size Quantity of bytes in message
+      @param  frame JACK frame of message
+      @note   Called from JACK process thread
+      @note   Time of 8 quarter frames is that of the first, received 2 frames
+     ago. 29.97 fps drop frame is treated as 30 fps.
+  */
+
+  static const uint8_t fps[] = {24, 25, 30, 30};
+  if (msg[0] == 0xf1 && size >= 2) {
+    uint8_t piece = (msg[1] >> 4) & 0x07;
+    g_mtcPiece[piece] = msg[1] & 0x0f;
+    if (piece == 0)
+      g_mtcPieces = 0;
+    g_mtcPieces |= 1 << piece;
+    if (piece != 7 || g_mtcPieces != 0xff)
+      return;
+    uint8_t rate = fps[(g_mtcPiece[7] >> 1) & 0x03];
+    uint32_t frames = g_mtcPiece[0] | (g_mtcPiece[1] << 4);
+    uint32_t seconds = g_mtcPiece[2] | (g_mtcPiece[3] << 4);
+    uint32_t minutes = g_mtcPiece[4] | (g_mtcPiece[5] << 4);
+    uint32_t hours = g_mtcPiece[6] | ((g_mtcPiece[7] & 0x01) << 4);
+    publishPosition(((hours * 60 + minutes) * 60 + seconds) * 1000 +
+                   (frames + 2) * 1000 / rate,
+               frame, true);
+  } else if (size >= 10 && msg[1] == 0x7f && msg[3] == 0x01 &&
+             msg[4] == 0x01) {
+    // Full frame F0 7F <device> 01 01 hh mm ss ff F7 - locate
+    uint8_t rate = fps[(msg[5] >> 5) & 0x03];
+    publishPosition(((msg[5] & 0x1f) * 3600 + msg[6] * 60 + msg[7]) * 1000 +
+                   msg[8] * 1000 / rate,
+               frame, false);
+  }
+}
+
+inline uint8_t *ccMessage(uint8_t *msg, uint8_t channel, uint8_t cc,
+                          uint8_t val) {
+  /*  @brief  Write MIDI CC message
+      @param  msg Buffer for 3-byte message
+      @param  channel MIDI channel [0..15]
+      @param  cc MIDI CC [0..127]
+      @param  val MIDI value [0..127]
+      @retval uint8_t* Pointer after message
+  */
+
+  msg[0] = 0xb0 | channel;
+  msg[1] = cc;
+  msg[2] = val;
+  return msg + 3;
+}
+
+uint8_t feedbackMessages(const MidiPort *port, uint16_t buffer, uint16_t *slot,
+                         uint8_t *msg) {
+  /*  @brief  Encode MIDI messages that set a slot to its DMX input value
+      @param  port Pointer to port feeding back the slot
+      @param  buffer Arena universe index (within port's universes)
+      @param  slot Pointer to DMX slot [0..511], set to coarse slot of a
+     16-bit coarse/fine pair
+      @param  msg Buffer for MAX_FEEDBACK_MESSAGES 3-byte messages
+      @retval uint8_t Quantity of messages (0 if slot is not mapped)
+      @note   Inverse of channel mode decoders. A universe addressed by both a
+     CC mode channel and a NRPN mode channel is fed back by CC.
+      @note   16-bit modes feed back slot pairs starting at even slots
+  */
+
+  uint16_t index = buffer - port->bufferBase;
+  const uint8_t *in = g_dmxIn[buffer];
+  uint8_t *end = msg;
+  uint8_t chan = index;
+  if (index < 16 && ((1 << chan) & port->midiChannels)) {
+    uint8_t val = in[*slot];
+    switch (port->mode[chan]) {
+    case MIDI_MODE_CC7:
+      if (*slot < 128)
+        end = ccMessage(end, chan, *slot, val >> 1);
+      break;
+    case MIDI_MODE_CC14:
+      if (*slot < 32) {
+        end = ccMessage(end, chan, *slot, val >> 1);
+        end = ccMessage(end, chan, *slot + 32, (val & 0x01) << 6);
+      }
+      break;
+    case MIDI_MODE_CC16:
+      if (*slot < 64) {
+        *slot &= ~1;
+        uint16_t val14 = ((in[*slot] << 8) | in[*slot + 1]) >> 2;
+        end = ccMessage(end, chan, *slot / 2, val14 >> 7);
+        end = ccMessage(end, chan, *slot / 2 + 32, val14 & 0x7f);
+      }
+      break;
+    }
+    if (end != msg)
+      return (end - msg) / 3;
+  }
+  chan = index / 32;
+  if (chan >= 16 || !((1 << chan) & port->midiChannels))
+    return 0;
+  uint8_t mode = port->mode[chan];
+  if (mode != MIDI_MODE_NRPN7 && mode != MIDI_MODE_NRPN14 &&
+      mode != MIDI_MODE_NRPN16)
+    return 0;
+  if (mode == MIDI_MODE_NRPN16)
+    *slot &= ~1;
+  uint16_t param = (index % 32) * 512 + *slot;
+  end = ccMessage(end, chan, MIDI_CMD_NRPN_MSB, param >> 7);
+  end = ccMessage(end, chan, MIDI_CMD_NRPN_LSB, param & 0x7f);
+  if (mode == MIDI_MODE_NRPN16) {
+    uint16_t val14 = ((in[*slot] << 8) | in[*slot + 1]) >> 2;
+    end = ccMessage(end, chan, MIDI_CMD_DATA_MSB, val14 >> 7);
+    end = ccMessage(end, chan, MIDI_CMD_DATA_LSB, val14 & 0x7f);
+  } else {
+    end = ccMessage(end, chan, MIDI_CMD_DATA_MSB, in[*slot] >> 1);
+    if (mode == MIDI_MODE_NRPN14)
+      end = ccMessage(end, chan, MIDI_CMD_DATA_LSB, (in[*slot] & 0x01) << 6);
+  }
+  return (end - msg) / 3;
+}
+
+void sendFeedback(MidiPort *port, void *midiBuffer, jack_nframes_t frames) {
+  /*  @brief  Send MIDI messages for changed DMX input slots of a port
+      @param  port Pointer to port
+      @param  midiBuffer Port's JACK MIDI output buffer
+      @param  frames Quantity of frames in this period
+      @note   Called from JACK process thread
+      @note   Rate limited to port's feedback rate. Slots left queued are sent
+     in following periods with their latest value.
+      @note   A slot stays queued until all its messages are written, so a full
+     buffer never drops a slot or splits a NRPN select / data sequence
+  */
+
+  Queue<uint32_t, FEEDBACK_QUEUE_SIZE> *queue =
+      &g_feedbackQueue[port - g_ports];
+  float credit = (float)frames * port->feedbackRate /
+                 jack_get_sample_rate(g_jackClient);
+  // Unused credit carries over for at most one slot's messages
+  port->feedbackCredit += credit;
+  if (port->feedbackCredit > credit + MAX_FEEDBACK_MESSAGES)
+    port->feedbackCredit = credit + MAX_FEEDBACK_MESSAGES;
+  uint8_t msg[MAX_FEEDBACK_MESSAGES * 3];
+  uint32_t id;
+  while (queue->peek(id)) {
+    uint16_t buffer = id >> 9, slot = id & 0x1ff;
+    uint8_t count = feedbackMessages(port, buffer, &slot, msg);
+    if (count > port->feedbackCredit ||
+        jack_midi_max_event_size(midiBuffer) <
+            count * (3 + MIDI_EVENT_OVERHEAD))
+      break;
+    // Clear before reading value so a later change queues the slot again
+    g_feedbackQueued[buffer][slot].exchange(false, std::memory_order_acq_rel);
+    count = feedbackMessages(port, buffer, &slot, msg);
+    uint8_t sent = 0;
+    while (sent < count &&
+           !jack_midi_event_write(midiBuffer, 0, msg + sent * 3, 3))
+      ++sent;
+    port->feedbackCredit -= sent;
+    if (sent < count) {
+      // Keep slot queued to send all its messages next period
+      g_feedbackQueued[buffer][slot].store(true, std::memory_order_release);
+      break;
+    }
+    queue->pop(id);
+  }
+}
+
+void dumpRequest(MidiPort *port, const uint8_t *msg, size_t size) {
+  /*  @brief  Handle SysEx dump request, replacing any dump in progress
+      @param  port Pointer to port that received the request
+      @param  msg SysEx message F0 7D 01 <universe MSB> <universe LSB>
+     <count MSB> <count LSB> F7, 14-bit values
+      @param  size Quantity of bytes in message
+      @note   Called from JACK process thread
+      @note   Range is limited to universes of all ports
+  */
+
+  if (size < 8 || msg[1] != SYSEX_ID || msg[2] != SYSEX_DUMP_REQUEST)
+    return;
+  uint16_t universe = (msg[3] << 7) | msg[4];
+  uint16_t count = (msg[5] << 7) | msg[6];
+  uint16_t universes = portUniverses();
+  uint32_t first = universe < g_arenaBase ? universes : universe - g_arenaBase;
+  if (first > universes)
+    first = universes;
+  uint32_t end = first + count;
+  port->dumpBuffer = first;
+  port->dumpEnd = end < universes ? end : universes;
+  port->dumpSlot = 0;
+  port->dumping = true;
+}
+
+size_t encodeDump(const uint8_t *data, uint16_t count, uint8_t *out) {
+  /*  @brief  Run length encode slots and pack into 7-bit SysEx data
+      @param  data Slot values
+      @param  count Quantity of slots [1..DUMP_CHUNK_SLOTS]
+      @param  out Buffer for packed data, at least count * 8 / 7 + 3 bytes
+      @retval size_t Bytes of packed data
+      @note   Control byte 0..127 is followed by that + 1 literal values,
+     128..255 by one value repeated control - 125 times (3..130)
+      @note   Each 7 bytes are packed as a byte holding their most
+     significant bits (first byte in bit 0) followed by their 7 low bits
+  */
+
+  uint8_t rle[DUMP_CHUNK_SLOTS + 2];
+  size_t length = 0;
+  int literal = -1; // Index of control byte of current literal values
+  for (uint16_t i = 0; i < count;) {
+    uint16_t run = 1;
+    while (i + run < count && run < 130 && data[i + run] == data[i])
+      ++run;
+    if (run >= 3) {
+      rle[length++] = run + 125;
+      rle[length++] = data[i];
+      i += run;
+      literal = -1;
+      continue;
+    }
+    if (literal < 0 || rle[literal] == 127) {
+      literal = length;
+      rle[length++] = 0;
+    } else {
+      ++rle[literal];
+    }
+    rle[length++] = data[i++];
+  }
+  size_t packed = 0;
+  for (size_t group = 0; group < length; group += 7) {
+    uint8_t *msbs = out + packed++;
+    *msbs = 0;
+    for (size_t i = group; i < group + 7 && i < length; ++i) {
+      *msbs |= (rle[i] >> 7) << (i - group);
+      out[packed++] = rle[i] & 0x7f;
+    }
+  }
+  return packed;
+}
+
+void sendDump(MidiPort *port, void *midiBuffer) {
+  /*  @brief  Send next messages of SysEx dump in progress
+      @param  port Pointer to port
+      @param  midiBuffer Port's JACK MIDI output buffer
+      @note   Called from JACK process thread
+      @note   Each message holds DUMP_CHUNK_SLOTS slots of one universe:
+     F0 7D 02 <universe MSB> <universe LSB> <slot MSB> <slot LSB> <data> F7.
+     As many messages are sent each period as fit the output buffer. The
+     dump ends with F0 7D 03 F7.
+  */
+
+  uint8_t msg[DUMP_CHUNK_BYTES];
+  while (port->dumping) {
+    size_t size = 0;
+    msg[size++] = 0xf0;
+    msg[size++] = SYSEX_ID;
+    if (port->dumpBuffer < port->dumpEnd) {
+      uint16_t universe = g_arenaBase + port->dumpBuffer;
+      msg[size++] = SYSEX_DUMP_DATA;
+      msg[size++] = universe >> 7;
+      msg[size++] = universe & 0x7f;
+      msg[size++] = port->dumpSlot >> 7;
+      msg[size++] = port->dumpSlot & 0x7f;
+      size += encodeDump(g_output[port->dumpBuffer] + port->dumpSlot,
+                         DUMP_CHUNK_SLOTS, msg + size);
+    } else {
+      msg[size++] = SYSEX_DUMP_END;
+    }
+    msg[size++] = 0xf7;
+    if (jack_midi_max_event_size(midiBuffer) < size ||
+        jack_midi_event_write(midiBuffer, 0, msg, size))
+      return; // Output buffer full, continue next period
+    if (port->dumpBuffer == port->dumpEnd) {
+      port->dumping = false;
+    } else if ((port->dumpSlot += DUMP_CHUNK_SLOTS) >= DMX_SLOTS) {
+      port->dumpSlot = 0;
+      ++port->dumpBuffer;
+    }
+  }
+}
+
+inline bool coalescible(const MidiPort *port, const uint8_t *msg) {
+  /*  @brief  Check if a MIDI message is superseded by a later value of its CC
+      @param  port Pointer to port that received the message
+      @param  msg MIDI message (at least 3 bytes)
+      @retval bool True for CC that sets an absolute value: a slot in cc7
+     mode, or a master, group or effect rate
+      @note   14-bit and NRPN modes, encoders and other functions depend on
+     the order or quantity of messages so are not coalescible. Effect level
+     is not coalescible as 0 stops an effect and other values start it.
+  */
+
+  uint8_t chan = msg[0] & 0x0f;
+  if ((msg[0] & 0xf0) != 0xb0 || !((1 << chan) & port->midiChannels))
+    return false;
+  uint16_t function = port->ccFunction[chan][msg[1] & 0x7f];
+  switch (function >> 8) {
+  case CC_FUNC_NONE:
+    return port->mode[chan] == MIDI_MODE_CC7;
+  case CC_FUNC_MASTER:
+  case CC_FUNC_GROUP:
+  case CC_FUNC_RATE:
+    return true;
   }
+  return false;
+}
+
+void coalesceEvents(const MidiPort *port, void *midiBuffer,
+                    jack_nframes_t count, uint64_t *skip) {
+  /*  @brief  Find CC messages superseded by a later message of the same MIDI
+     channel and CC in this period
+      @param  port Pointer to port
+      @param  midiBuffer Port's JACK MIDI input buffer
+      @param  count Quantity of events in buffer
+      @param  skip Bitwise flags to populate for events to skip (first
+     COALESCE_EVENTS events)
+      @note   Called from JACK process thread
+      @note   Scans events from last to first so the last value of each CC is
+     kept in its place and the order of kept events is unchanged
+  */
+
+  uint64_t seen[16 * 128 / 64] = {}; // Bitwise flags for channel << 7 | CC
+  jack_midi_event_t midiEvent;
+  memset(skip, 0, COALESCE_EVENTS / 8);
+  for (jack_nframes_t eventIndex = count; eventIndex-- > 0;) {
+    if (jack_midi_event_get(&midiEvent, midiBuffer, eventIndex) ||
+        midiEvent.size < 3 || !coalescible(port, midiEvent.buffer))
+      continue;
+    uint16_t key = ((midiEvent.buffer[0] & 0x0f) << 7) |
+                   (midiEvent.buffer[1] & 0x7f);
+    if (!(seen[key / 64] & (1ULL << (key % 64))))
+      seen[key / 64] |= 1ULL << (key % 64);
+    else if (eventIndex < COALESCE_EVENTS)
+      skip[eventIndex / 64] |= 1ULL << (eventIndex % 64);
+  }
+}
+
+int onJackProcess(jack_nframes_t frames, void *args) {
+  // Process MIDI input from each port into the event queue
+  uint8_t cmd, chan, cc, val;
+  jack_midi_event_t midiEvent;
+  uint64_t skip[COALESCE_EVENTS / 64]; // Bitwise flags for coalesced events
+  jack_nframes_t periodFrame = jack_last_frame_time(g_jackClient);
+  uint32_t delay = g_playbackLatency - g_fixtureLatency * 1000;
+  for (uint8_t portIndex = 0; portIndex < g_portCount; ++portIndex) {
+    MidiPort *port = &g_ports[portIndex];
+    void *midiBuffer = jack_port_get_buffer(port->jackPort, frames);
+    jack_nframes_t count = jack_midi_get_event_count(midiBuffer);
+    if (g_enableCC && count > 1)
+      coalesceEvents(port, midiBuffer, count, skip);
+    else
+      memset(skip, 0, sizeof(skip));
+    for (jack_nframes_t eventIndex = 0; eventIndex < count; ++eventIndex) {
+      if ((eventIndex < COALESCE_EVENTS &&
+           (skip[eventIndex / 64] >> (eventIndex % 64)) & 1) ||
+          jack_midi_event_get(&midiEvent, midiBuffer, eventIndex))
+        continue;
+      if (g_align)
+        g_eventDue = jack_frames_to_time(g_jackClient,
+                                         periodFrame + midiEvent.time) +
+                     delay;
+      cmd = midiEvent.buffer[0] & 0xf0;
+      // debug("Rx MIDI event %u/%u: %02x\n", eventIndex + 1, count, cmd);
+      if (g_enableCC && cmd == 0xb0) {
+        // MIDI CC
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        cc = midiEvent.buffer[1];
+        val = midiEvent.buffer[2];
+        uint16_t function = port->ccFunction[chan][cc & 0x7f];
+        if (function == CC_FUNC_NONE)
+          port->ccHandler[chan](port, chan, cc, val);
+        else if (function >> 8 == CC_FUNC_ENCODER)
+          encoderCC(port, chan, cc & 0x7f, function & 0xff, val,
+                    periodFrame + midiEvent.time);
+        else
+          ccFunction(port, chan, function, val);
+      } else if ((cmd == 0x80 || cmd == 0x90) &&
+                 port->noteFunction[midiEvent.buffer[0] & 0x0f]
+                                   [midiEvent.buffer[1] & 0x7f]) {
+        // MIDI Note assigned to a function - note-off sets value 0
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        cc = midiEvent.buffer[1] & 0x7f;
+        val = cmd == 0x90 ? midiEvent.buffer[2] : 0;
+        ccFunction(port, chan, port->noteFunction[chan][cc], val);
+      } else if (g_enableNoteOff && (cmd == 0x80)) {
+        // MIDI Note-off
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        cc = midiEvent.buffer[1];
+        cc7(port, chan, cc, 0);
+      } else if (g_enableNote && (cmd == 0x90)) {
+        // MIDI Note-on
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        cc = midiEvent.buffer[1];
+        val = midiEvent.buffer[2];
+        if (port->noteFade && val)
+          noteFade(port, chan, cc, val);
+        else
+          cc7(port, chan, cc, val);
+      } else if (g_enablePolyPressure && (cmd == 0xa0)) {
+        // MIDI Polyphonic aftertouch - same slot as note
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        cc = midiEvent.buffer[1];
+        val = midiEvent.buffer[2];
+        cc7(port, chan, cc, val);
+      } else if (cmd == 0xd0) {
+        // MIDI Channel pressure
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        channelPressure(port, chan, midiEvent.buffer[1]);
+      } else if (cmd == 0xc0) {
+        // MIDI Program change
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (chan == port->cueChannel)
+          pushEvent({0, CUE_GOTO, midiEvent.buffer[1], 0, portIndex,
+                     EVENT_FLAG_CUE});
+        if (chan == port->sceneChannel)
+          pushEvent({0, SCENE_RECALL,
+                     (uint16_t)((port->sceneBank << 7) | midiEvent.buffer[1]),
+                     port->state[chan].fadeTime, portIndex,
+                     EVENT_FLAG_SCENE});
+      } else if (cmd == 0xf0) {
+        // MIDI System message - clock of clock port, time code of MTC port
+        if (portIndex == g_clockPort)
+          clockMessage(midiEvent.buffer, midiEvent.size,
+                       periodFrame + midiEvent.time);
+        if (portIndex == g_mtcPort)
+          mtcMessage(midiEvent.buffer, midiEvent.size,
+                     periodFrame + midiEvent.time);
+        if (port->dump)
+          dumpRequest(port, midiEvent.buffer, midiEvent.size);
+      } else if (cmd == 0xe0) {
+        // MIDI Pitch bend
+        chan = midiEvent.buffer[0] & 0x0f;
+        if (((1 << chan) & port->midiChannels) == 0)
+          continue;
+        pitchBend(port, chan, midiEvent.buffer[1], midiEvent.buffer[2]);
+      }
+    }
+  }
+  if (g_transport && g_show) {
+    // Transport frame is the position at the start of this period
+    jack_position_t position;
+    jack_transport_state_t state = jack_transport_query(g_jackClient, &position);
+    if (position.frame_rate)
+      publishPosition((uint64_t)position.frame * 1000 / position.frame_rate,
+                      periodFrame, state == JackTransportRolling);
+  }
+  // Changes from this period become visible to output thread together
+  g_eventQueue.publish();
+  for (uint8_t portIndex = 0; portIndex < g_portCount; ++portIndex) {
+    MidiPort *port = &g_ports[portIndex];
+    if (!port->outputPort)
+      continue;
+    void *midiBuffer = jack_port_get_buffer(port->outputPort, frames);
+    jack_midi_clear_buffer(midiBuffer);
+    sendFeedback(port, midiBuffer, frames);
+    sendDump(port, midiBuffer);
+  }
+  if (g_freewheel && g_recordFrames) {
+    // Not real-time so wait for output thread to render each frame due
+    jack_nframes_t rate = jack_get_sample_rate(g_jackClient);
+    g_freewheelFrames += (uint64_t)frames * g_refreshRate;
+    while (g_freewheelFrames >= rate) {
+      g_freewheelFrames -= rate;
+      sem_post(&g_freewheelTick);
+      sem_wait(&g_freewheelDone);
+    }
+  }
+  return 0;
+}
+
+void onJackFreewheel(int starting, void *args) {
+  // Switch output thread between clock pacing and JACK processing
+  g_freewheel = starting;
+}
+
+void setGroup(uint8_t group, uint8_t val, uint16_t fade, uint8_t source) {
+  /*  @brief  Set level of each member of a group
+      @param  group Index of group
+      @param  val Group level [0..255]
+      @param  fade Time to fade to new value in ms
+      @param  source Index of layer to change
+      @note   Called from output thread
+  */
+
+  for (uint16_t i = g_groupStart[group]; i < g_groupStart[group + 1]; ++i) {
+    const GroupMember *member = &g_groupMembers[i];
+    g_layer[source][member->buffer][member->slot] =
+        (val * member->scale) >> 8;
+    g_owner[member->buffer][member->slot] = source;
+    g_fadeTime[member->buffer][member->slot] = fade;
+    g_sourceMask[member->buffer] |= 1UL << source;
+    g_dirty[member->buffer / 64] |= 1ULL << (member->buffer % 64);
+  }
+}
+
+void setEffect(uint8_t index, uint8_t level) {
+  /*  @brief  Start, stop or change level of an effect
+      @param  index Index of effect
+      @param  level Effect level [0..255], 0 to stop
+      @note   Called from output thread
+      @note   Starting an effect restarts its cycle and takes LTP ownership of
+     its slots. Stopping the last effect on a slot returns ownership to the
+     source that owned it before.
+  */
+
+  Effect *effect = &g_effects[index];
+  if (!effect->period)
+    return;
+  uint16_t first = g_groupStart[effect->group];
+  uint16_t last = g_groupStart[effect->group + 1];
+  if (level && !effect->level) {
+    effect->phase = 0;
+    for (uint16_t i = first; i < last; ++i) {
+      const GroupMember *member = &g_groupMembers[i];
+      uint8_t &owner = g_owner[member->buffer][member->slot];
+      if (owner != EFFECT_SOURCE)
+        g_effectOwner[member->buffer][member->slot] = owner;
+      owner = EFFECT_SOURCE;
+      g_fadeTime[member->buffer][member->slot] = 0;
+      g_sourceMask[member->buffer] |= 1UL << EFFECT_SOURCE;
+    }
+    g_effectsRunning |= 1UL << index;
+  } else if (!level && effect->level) {
+    for (uint16_t i = first; i < last; ++i) {
+      const GroupMember *member = &g_groupMembers[i];
+      g_layer[EFFECT_SOURCE][member->buffer][member->slot] = 0;
+      uint8_t &owner = g_owner[member->buffer][member->slot];
+      if (owner == EFFECT_SOURCE)
+        owner = g_effectOwner[member->buffer][member->slot];
+    }
+    for (uint16_t word = 0; word < MAX_UNIVERSE / 64; ++word)
+      g_dirty[word] |= g_effectUniverses[index][word];
+    g_effectsRunning &= ~(1UL << index);
+    // Slots shared with effects still running stay owned by effects
+    for (uint8_t other = 0; other < MAX_EFFECTS; ++other) {
+      if (!(g_effectsRunning & (1UL << other)))
+        continue;
+      for (uint16_t i = g_groupStart[g_effects[other].group];
+           i < g_groupStart[g_effects[other].group + 1]; ++i)
+        g_owner[g_groupMembers[i].buffer][g_groupMembers[i].slot] =
+            EFFECT_SOURCE;
+    }
+  }
+  effect->level = level;
+}
+
+void runCueChanges(const CueChange *changes, uint32_t count, uint16_t fade) {
+  /*  @brief  Apply slot changes of a cue to the cue layer
+      @param  changes Pointer to first change
+      @param  count Quantity of changes
+      @param  fade Time to fade to new values in ms
+      @note   Called from output thread
+  */
+
+  for (const CueChange *change = changes; change < changes + count; ++change) {
+    g_layer[CUE_SOURCE][change->buffer][change->slot] = change->value;
+    g_owner[change->buffer][change->slot] = CUE_SOURCE;
+    g_fadeTime[change->buffer][change->slot] = fade;
+    g_sourceMask[change->buffer] |= 1UL << CUE_SOURCE;
+    g_dirty[change->buffer / 64] |= 1ULL << (change->buffer % 64);
+  }
+}
+
+void runCue(uint8_t command, uint16_t index) {
+  /*  @brief  Run a cue command
+      @param  command CUE_COMMAND
+      @param  index Index of cue for CUE_GOTO
+      @note   Called from output thread
+      @note   GOTO runs each cue between the current and requested cue, which
+     only changes the layer, so all fade together from current levels
+      @note   Fade time is that of the cue being moved to (or from on BACK to
+     before first cue)
+  */
+
+  int32_t target = g_cue;
+  if (command == CUE_GO)
+    target = g_cue + 1;
+  else if (command == CUE_BACK)
+    target = g_cue - 1;
+  else if (index < g_cueCount)
+    target = index;
+  if (target < -1 || target >= g_cueCount || target == g_cue)
+    return;
+  uint16_t fade = g_cues[target < 0 ? 0 : target].fade;
+  while (g_cue < target) {
+    const Cue *cue = &g_cues[++g_cue];
+    runCueChanges(g_cueChanges + cue->changes, cue->count, fade);
+  }
+  while (g_cue > target) {
+    const Cue *cue = &g_cues[g_cue--];
+    runCueChanges(g_cueChanges + cue->changes + cue->count, cue->count, fade);
+  }
+  debug("Cue %d\n", g_cue + 1);
+}
+
+void recallScene(uint16_t index, uint16_t fade, uint8_t source) {
+  /*  @brief  Copy a scene from the scene bank into a source layer
+      @param  index Index of scene
+      @param  fade Time to fade to scene in ms
+      @param  source Index of layer to change
+      @note   Called from output thread
+      @note   Source takes LTP ownership of all slots in the scene
+  */
+
+  g_scene = index;
+  if (!g_sceneBank || index >= g_sceneBank->scenes)
+    return;
+  const uint8_t *scene =
+      g_scenes + (size_t)index * g_sceneBank->universes * DMX_SLOTS;
+  uint16_t first = g_sceneBank->universe - g_arenaBase;
+  for (uint16_t buffer = first; buffer < first + g_sceneBank->universes;
+       ++buffer) {
+    memcpy(g_layer[source][buffer], scene, DMX_SLOTS);
+    memset(g_owner[buffer], source, DMX_SLOTS);
+    for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot)
+      g_fadeTime[buffer][slot] = fade;
+    g_sourceMask[buffer] |= 1UL << source;
+    g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+    scene += DMX_SLOTS;
+  }
+  debug("Recalled scene %u\n", index + 1);
+}
+
+void captureScene(uint16_t index) {
+  /*  @brief  Copy merged universes to a scene in the scene bank
+      @param  index Index of scene
+      @note   Called from output thread
+      @note   Written through the memory map, so the bank file holds the scene
+  */
+
+  if (!g_sceneBank || index >= g_sceneBank->scenes)
+    return;
+  uint8_t *scene = g_scenes + (size_t)index * g_sceneBank->universes * DMX_SLOTS;
+  uint16_t first = g_sceneBank->universe - g_arenaBase;
+  for (uint16_t buffer = first; buffer < first + g_sceneBank->universes;
+       ++buffer) {
+    memcpy(scene, g_merged[buffer], DMX_SLOTS);
+    scene += DMX_SLOTS;
+  }
+  msync(g_sceneBank, g_sceneBankSize, MS_ASYNC);
+  info("Captured scene %u\n", index + 1);
+}
+
+void onJackLatency(jack_latency_callback_mode_t mode, void *args) {
+  // Request update of playback latency from output thread
+  if (mode == JackPlaybackLatency)
+    g_latencyChanged = true;
+}
+
+void updateLatency() {
+  /*  @brief  Update audio playback latency from physical playback ports
+      @note   Called from output thread
+      @note   Uses the greatest latency of all physical audio outputs
+  */
+
+  if (!g_align || !g_latencyChanged.exchange(false))
+    return;
+  const char **ports =
+      jack_get_ports(g_jackClient, NULL, JACK_DEFAULT_AUDIO_TYPE,
+                     JackPortIsPhysical | JackPortIsInput);
+  jack_nframes_t latency = 0;
+  for (uint16_t i = 0; ports && ports[i]; ++i) {
+    jack_latency_range_t range;
+    jack_port_get_latency_range(jack_port_by_name(g_jackClient, ports[i]),
+                                JackPlaybackLatency, &range);
+    if (range.max > latency)
+      latency = range.max;
+  }
+  jack_free(ports);
+  g_playbackLatency =
+      (uint64_t)latency * 1000000 / jack_get_sample_rate(g_jackClient);
+  info("Audio playback latency: %uus, fixture latency: %ums\n",
+       g_playbackLatency.load(), g_fixtureLatency);
+}
+
+void applyEvent(const SlotEvent &event, uint16_t *masters) {
+  /*  @brief  Apply a slot change to universe arena
+      @param  event Slot change
+      @param  masters Pointer to bitwise flags for masters changed
+      @note   Called from output thread
+  */
+
+  if (event.flags & EVENT_FLAG_MASTER) {
+    g_masterLevel[event.slot] = event.value;
+    *masters |= 1 << event.slot;
+    return;
+  }
+  if (event.flags & EVENT_FLAG_GROUP) {
+    setGroup(event.slot, event.value, event.fade, event.source);
+    return;
+  }
+  if (event.flags & EVENT_FLAG_EFFECT) {
+    setEffect(event.slot, event.value);
+    return;
+  }
+  if (event.flags & EVENT_FLAG_SCENE) {
+    if (event.slot == SCENE_RECALL)
+      recallScene(event.value, event.fade, event.source);
+    else
+      captureScene(g_scene);
+    return;
+  }
+  if (event.flags & EVENT_FLAG_CUE) {
+    runCue(event.slot, event.value);
+    return;
+  }
+  if (event.flags & EVENT_FLAG_RATE) {
+    g_effects[event.slot].rate = event.value;
+    updateStep(&g_effects[event.slot]);
+    return;
+  }
+  uint8_t *layer = g_layer[event.source][event.buffer];
+  if (event.flags & EVENT_FLAG_16BIT) {
+    layer[event.slot] = event.value >> 8;
+    layer[event.slot + 1] = event.value & 0xff;
+    g_owner[event.buffer][event.slot + 1] = event.source;
+    g_fadeTime[event.buffer][event.slot + 1] = 0;
+  } else {
+    layer[event.slot] = event.value;
+  }
+  g_fadeTime[event.buffer][event.slot] = event.fade;
+  g_owner[event.buffer][event.slot] = event.source;
+  g_sourceMask[event.buffer] |= 1UL << event.source;
+  g_dirty[event.buffer / 64] |= 1ULL << (event.buffer % 64);
+}
+
+void processEvents() {
+  /*  @brief  Apply queued slot changes to universe arena
+      @note   Called from output thread
+      @note   Queue is in time order for each port but not across ports so
+     changes not yet due are held without blocking changes behind them
+  */
+
+  SlotEvent event;
+  uint16_t masters = 0; // Bitwise flags for masters changed
+  // Release changes due before the middle of the next refresh period
+  // While freewheeling, changes are applied in the frame of their period
+  bool align = g_align && !g_freewheel;
+  uint32_t now = align ? jack_get_time() + 500000 / g_refreshRate : 0;
+  uint32_t held = 0;
+  for (uint32_t i = 0; i < g_heldCount; ++i) {
+    if (align && (int32_t)(g_heldEvents[i].due - now) > 0)
+      g_heldEvents[held++] = g_heldEvents[i];
+    else
+      applyEvent(g_heldEvents[i], &masters);
+  }
+  g_heldCount = held;
+  while (g_eventQueue.peek(event)) {
+    if (!align || (int32_t)(event.due - now) <= 0)
+      applyEvent(event, &masters);
+    else if (g_heldCount < EVENT_QUEUE_SIZE)
+      g_heldEvents[g_heldCount++] = event;
+    else
+      break;
+    g_eventQueue.pop(event);
+  }
+  if (masters) {
+    // Rescale and resend only universes with slots of changed masters
+    for (uint16_t word = 0; word < MAX_UNIVERSE / 64; ++word) {
+      uint64_t changed = 0;
+      for (uint8_t master = 0; master < MAX_MASTERS; ++master)
+        if (masters & (1 << master))
+          changed |= g_masterUniverses[master][word];
+      g_dirty[word] |= changed;
+      while (changed) {
+        updateScale(word * 64 + __builtin_ctzll(changed));
+        changed &= changed - 1;
+      }
+    }
+  }
+  if (g_captureScene.exchange(false))
+    captureScene(g_scene);
+  uint32_t overflow = g_eventOverflow.exchange(0, std::memory_order_relaxed);
+  if (overflow)
+    error("Event queue full. Dropped %u slot changes\n", overflow);
+  overflow = g_feedbackOverflow.exchange(0, std::memory_order_relaxed);
+  if (overflow)
+    error("Feedback queue full. Dropped %u slot changes\n", overflow);
+}
+
+void renderEffect(uint8_t index) {
+  /*  @brief  Render current cycle position of an effect into effect layer
+      @param  index Index of effect
+      @note   Called from output thread each refresh period
+      @note   Calculates 4 members per iteration using vector integer math
+  */
+
+  Effect *effect = &g_effects[index];
+  const GroupMember *members = g_groupMembers + g_groupStart[effect->group];
+  uint32_t count = g_groupStart[effect->group + 1] - g_groupStart[effect->group];
+  uint32_t phase = effect->phase;
+  uint32_t cycle = effect->phase >> 32;
+  uint32_t width = count ? 0xffffffffU / count : 0;
+  uint32_t level = effect->level + 1;
+  const v4u32 lane = {0, 1, 2, 3};
+  for (uint32_t i = 0; i < count; i += 4) {
+    v4u32 member = lane + i;
+    v4u32 offset = member * effect->spreadStep;
+    v4u32 pos = phase - offset; // Each member lags previous member by offset
+    v4u32 val;
+    switch (effect->shape) {
+    case EFFECT_SINE:
+      for (uint8_t j = 0; j < 4; ++j)
+        val[j] = g_sine[pos[j] >> 24];
+      break;
+    case EFFECT_SQUARE:
+      val = (v4u32)((v4i32)pos >= 0) & 0xff;
+      break;
+    case EFFECT_RAMP:
+      val = pos >> 24;
+      break;
+    case EFFECT_RANDOM: {
+      // Hash of member and its cycle, one less while its lag wraps
+      v4u32 hash = (cycle + (v4u32)(pos > phase)) * 0x9e3779b1U;
+      hash ^= (member + (index << 16)) * 0x85ebca6bU;
+      hash ^= hash >> 15;
+      hash *= 0x2c1b3c6dU;
+      hash ^= hash >> 12;
+      hash *= 0x297a2d39U;
+      hash ^= hash >> 15;
+      val = hash >> 24;
+      break;
+    }
+    default: // EFFECT_CHASE
+      val = (v4u32)(pos < width) & 0xff;
+    }
+    val = (val * level) >> 8;
+    uint32_t lanes = count - i < 4 ? count - i : 4;
+    for (uint8_t j = 0; j < lanes; ++j) {
+      const GroupMember *target = &members[i + j];
+      g_layer[EFFECT_SOURCE][target->buffer][target->slot] =
+          (val[j] * target->scale) >> 8;
+    }
+  }
+}
+
+double clockBeats() {
+  /*  @brief  Get position of MIDI clock
+      @retval double Beats since start
+      @note   Called from output thread
+      @note   Interpolates between clocks using estimated interval, up to one
+     clock ahead. Holds while stopped.
+  */
+
+  uint32_t sequence, frame;
+  int32_t ticks;
+  float interval;
+  bool running;
+  do {
+    sequence = g_clock.sequence.load(std::memory_order_acquire);
+    ticks = g_clock.ticks.load(std::memory_order_relaxed);
+    frame = g_clock.frame.load(std::memory_order_relaxed);
+    interval = g_clock.interval.load(std::memory_order_relaxed);
+    running = g_clock.running.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((sequence & 1) ||
+           sequence != g_clock.sequence.load(std::memory_order_relaxed));
+  if (ticks < 0)
+    return 0;
+  double elapsed = 0;
+  if (running && interval > 0) {
+    elapsed = (int32_t)(jack_frame_time(g_jackClient) - frame) / interval;
+    elapsed = elapsed < 0 ? 0 : elapsed > 1 ? 1 : elapsed;
+  }
+  return (ticks + elapsed) / 24;
+}
+
+void renderEffects() {
+  /*  @brief  Render running effects and advance their cycles
+      @note   Called from output thread each refresh period
+  */
+
+  double beats = g_clockPort >= 0 ? clockBeats() : 0;
+  for (uint32_t running = g_effectsRunning; running; running &= running - 1) {
+    uint8_t index = __builtin_ctz(running);
+    Effect *effect = &g_effects[index];
+    if (effect->beats)
+      effect->phase = beats / effect->beats * 4294967296.0;
+    renderEffect(index);
+    effect->phase += effect->step;
+    for (uint16_t word = 0; word < MAX_UNIVERSE / 64; ++word)
+      g_dirty[word] |= g_effectUniverses[index][word];
+  }
+}
+
+bool decodeShowFrame(size_t offset) {
+  /*  @brief  Decode a show record into the show layer
+      @param  offset Offset of record in show file
+      @retval bool False if record is not within show file (not decoded)
+      @note   Called from output thread
+      @note   Universes of show are contiguous in the layer so keyframes are
+     one copy and deltas are applied across universe boundaries
+  */
+
+  ShowRecord record;
+  if (offset + sizeof(record) > g_showSize)
+    return false;
+  memcpy(&record, g_show + offset, sizeof(record));
+  if (record.size > g_showSize - offset - sizeof(record))
+    return false;
+  const uint8_t *data = g_show + offset + sizeof(record);
+  uint16_t first = g_showHeader.universe - g_arenaBase;
+  uint8_t *frame = g_layer[SHOW_SOURCE][first];
+  size_t frameSize = (size_t)g_showHeader.universes * DMX_SLOTS;
+  if (record.type == SHOW_KEYFRAME) {
+    memcpy(frame, data, record.size < frameSize ? record.size : frameSize);
+    for (uint16_t buffer = first; buffer < first + g_showHeader.universes;
+         ++buffer)
+      g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+  } else {
+    const uint8_t *end = data + record.size;
+    size_t slot = 0;
+    while (data + 4 <= end) {
+      uint16_t skip = data[0] | (data[1] << 8);
+      uint16_t count = data[2] | (data[3] << 8);
+      data += 4;
+      slot += skip;
+      if (slot + count > frameSize || data + count > end)
+        break;
+      for (size_t i = 0; i < count; ++i)
+        frame[slot + i] ^= data[i];
+      for (size_t buffer = first + slot / DMX_SLOTS;
+           buffer <= first + (slot + count - 1) / DMX_SLOTS && count; ++buffer)
+        g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+      slot += count;
+      data += count;
+    }
+  }
+  g_showFrame = record.frame;
+  g_showNext = offset + sizeof(record) + record.size;
+  return true;
+}
+
+void seekShow(uint32_t frame) {
+  /*  @brief  Decode a show frame from the nearest keyframe at or before it
+      @param  frame Frame number
+      @note   Called from output thread
+  */
+
+  uint32_t low = 0, high = g_showHeader.keyframes;
+  while (high - low > 1) {
+    uint32_t mid = (low + high) / 2;
+    if (g_showIndex[mid].frame <= frame)
+      low = mid;
+    else
+      high = mid;
+  }
+  if (!decodeShowFrame(g_showIndex[low].offset))
+    return;
+  while (g_showFrame < frame)
+    if (!decodeShowFrame(g_showNext))
+      break;
+  g_showReadahead = 0;
+}
+
+void playShow() {
+  /*  @brief  Update show layer to frame at MIDI Time Code or JACK transport
+     position
+      @note   Called from output thread each refresh period
+      @note   Position is extrapolated from last quarter frame (or JACK
+     period) for up to 125ms, so playback holds if time code stops
+  */
+
+  uint64_t position = g_showPosition.load(std::memory_order_acquire);
+  if (!g_show || !(position & (1ULL << 62)))
+    return;
+  double ms = (position >> 32) & 0x3fffffff;
+  if (position >> 63) {
+    int32_t elapsed = jack_frame_time(g_jackClient) - (uint32_t)position;
+    double limit = jack_get_sample_rate(g_jackClient) / 8.0;
+    if (elapsed > 0)
+      ms += (elapsed < limit ? elapsed : limit) * 1000.0 /
+            jack_get_sample_rate(g_jackClient);
+  }
+  int64_t frame = ms * g_showHeader.rate / 1000;
+  if (frame >= g_showHeader.frames)
+    frame = g_showHeader.frames - 1;
+  if (frame == g_showFrame)
+    return;
+  if (g_showFrame < 0) {
+    // Show takes LTP ownership of its universes when it starts
+    uint16_t first = g_showHeader.universe - g_arenaBase;
+    for (uint16_t buffer = first; buffer < first + g_showHeader.universes;
+         ++buffer) {
+      memset(g_owner[buffer], SHOW_SOURCE, DMX_SLOTS);
+      memset(g_fadeTime[buffer], 0, sizeof(g_fadeTime[buffer]));
+      g_sourceMask[buffer] |= 1UL << SHOW_SOURCE;
+    }
+  }
+  // First frame seeks as there is no previous record
+  if (g_showFrame >= 0 && frame == g_showFrame + 1)
+    decodeShowFrame(g_showNext);
+  else
+    seekShow(frame);
+  if (g_showNext + SHOW_READAHEAD / 2 > g_showReadahead) {
+    // Ask kernel to read following frames from disk
+    size_t start = g_showNext & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+    size_t length = SHOW_READAHEAD;
+    if (start + length > g_showSize)
+      length = g_showSize - start;
+    madvise(g_show + start, length, MADV_WILLNEED);
+    g_showReadahead = start + length;
+  }
+}
+
+size_t encodeDelta(const uint8_t *frame, const uint8_t *previous, size_t size,
+                   uint8_t *out) {
+  /*  @brief  Encode a frame as XOR runs against the previous frame
+      @param  frame Frame to encode
+      @param  previous Previous frame
+      @param  size Bytes in frame (multiple of 16)
+      @param  out Buffer for encoded data, at least size * 5 / 4 + 4 bytes
+      @retval size_t Bytes of encoded data
+      @note   Unchanged blocks of 16 slots are skipped with one vector compare
+      @note   Runs continue over up to 4 unchanged slots, which cost less than
+     a new run
+  */
+
+  size_t length = 0, slot = 0;
+  uint32_t skip = 0;
+  while (slot < size) {
+    if (!(slot & 15)) {
+      v16u8 changed = (v16u8)(*(v16u8 *)(frame + slot) !=
+                              *(v16u8 *)(previous + slot));
+      uint64_t any[2];
+      memcpy(any, &changed, sizeof(any));
+      if (!(any[0] | any[1])) {
+        skip += 16;
+        slot += 16;
+        continue;
+      }
+    }
+    if (frame[slot] == previous[slot]) {
+      ++skip;
+      ++slot;
+      continue;
+    }
+    for (; skip > 0xffff; skip -= 0xffff) {
+      out[length++] = 0xff;
+      out[length++] = 0xff;
+      out[length++] = 0;
+      out[length++] = 0;
+    }
+    size_t run = length;
+    uint16_t count = 0;
+    length += 4;
+    while (slot < size && count < 0xffff) {
+      if (frame[slot] == previous[slot]) {
+        size_t gap = 1;
+        while (gap < 5 && slot + gap < size &&
+               frame[slot + gap] == previous[slot + gap])
+          ++gap;
+        if (gap == 5 || slot + gap == size)
+          break;
+      }
+      out[length++] = frame[slot] ^ previous[slot];
+      ++count;
+      ++slot;
+    }
+    out[run] = skip;
+    out[run + 1] = skip >> 8;
+    out[run + 2] = count;
+    out[run + 3] = count >> 8;
+    skip = 0;
+  }
+  return length;
+}
+
+void *recordThread(void *arg) {
+  /*  @brief  Recorder thread, encodes queued frames and writes show file
+      @param  arg Pointer to open show file
+      @note   Writes seek index and final header when stopped
+  */
+
+  FILE *file = (FILE *)arg;
+  size_t size = (size_t)g_recordUniverses * DMX_SLOTS;
+  uint8_t *previous = (uint8_t *)calloc(size, 1);
+  uint8_t *delta = (uint8_t *)malloc(size * 5 / 4 + 4);
+  ShowHeader header = {"MIDISHW", 1, g_arenaBase, g_recordUniverses,
+                       g_refreshRate, 0, 0, 0};
+  ShowIndex *index = NULL;
+  uint32_t capacity = 0, lastKeyframe = 0;
+  uint32_t popped = 0; // Quantity of frames popped, selects ring entry
+  uint64_t offset = sizeof(header);
+  bool failed = false;
+  while (true) {
+    sem_wait(&g_recordWake);
+    uint32_t number;
+    bool stop = g_recordStop;
+    while (g_recordQueue.pop(number)) {
+      const uint8_t *frame =
+          g_recordFrames + (size_t)(popped++ % RECORD_QUEUE) * size;
+      ShowRecord record = {number, SHOW_DELTA, 0, 0};
+      const uint8_t *data = delta;
+      if (!header.keyframes ||
+          number - lastKeyframe >= KEYFRAME_INTERVAL * g_refreshRate) {
+        record.type = SHOW_KEYFRAME;
+        record.size = size;
+        data = frame;
+        if (header.keyframes >= capacity) {
+          capacity = capacity ? capacity * 2 : 1024;
+          index = (ShowIndex *)realloc(index, capacity * sizeof(ShowIndex));
+        }
+        index[header.keyframes++] = {number, 0, offset};
+        lastKeyframe = number;
+      } else {
+        record.size = encodeDelta(frame, previous, size, delta);
+      }
+      memcpy(previous, frame, size);
+      if (fwrite(&record, sizeof(record), 1, file) != 1 ||
+          (record.size && fwrite(data, record.size, 1, file) != 1)) {
+        if (!failed)
+          error("Failed to write show file %s\n", g_recordPath);
+        failed = true;
+      }
+      offset += sizeof(record) + record.size;
+      header.frames = number + 1;
+    }
+    if (stop)
+      break;
+  }
+  header.index = offset;
+  fwrite(index, sizeof(ShowIndex), header.keyframes, file);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  fclose(file);
+  info("Recorded %u frames to %s\n", header.frames, g_recordPath);
+  free(index);
+  free(previous);
+  free(delta);
+  return NULL;
+}
+
+bool startRecorder() {
+  /*  @brief  Create show file and start recorder thread
+      @retval bool True on success
+  */
+
+  if (!g_recordPath[0])
+    return true;
+  g_recordUniverses = portUniverses();
+  FILE *file = fopen(g_recordPath, "wb");
+  ShowHeader header = {"MIDISHW", 1, g_arenaBase, g_recordUniverses,
+                       g_refreshRate, 0, 0, 0};
+  if (!file || fwrite(&header, sizeof(header), 1, file) != 1) {
+    error("Failed to create show file %s\n", g_recordPath);
+    return false;
+  }
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+  sem_init(&g_recordWake, 0, 0);
+  sem_init(&g_freewheelTick, 0, 0);
+  sem_init(&g_freewheelDone, 0, 0);
+  g_recordFrames =
+      (uint8_t *)malloc((size_t)RECORD_QUEUE * g_recordUniverses * DMX_SLOTS);
+  if (!g_recordFrames ||
+      pthread_create(&g_recordThread, NULL, recordThread, file)) {
+    error("Failed to start recorder\n");
+    return false;
+  }
+  return true;
+}
+
+void stopRecorder() {
+  // Stop recorder thread, which finishes writing show file
+  if (!g_recordFrames)
+    return;
+  g_recordStop = true;
+  sem_post(&g_recordWake);
+  pthread_join(g_recordThread, NULL);
+  uint32_t dropped = g_recordDropped.load();
+  if (dropped)
+    error("Recorder dropped %u frames\n", dropped);
+}
+
+void recordFrame() {
+  /*  @brief  Queue output frames of this refresh period for recorder
+      @note   Called from output thread after sendDirty
+      @note   Universes are contiguous in the output arena, so this is one
+     copy. If the recorder falls behind, the frame is dropped, except while
+     freewheeling when rendering waits for the recorder.
+  */
+
+  if (!g_recordFrames)
+    return;
+  size_t size = (size_t)g_recordUniverses * DMX_SLOTS;
+  bool queued = g_recordQueue.push(g_recordFrame);
+  while (!queued && g_freewheel && !g_recordStop) {
+    usleep(1000);
+    queued = g_recordQueue.push(g_recordFrame);
+  }
+  ++g_recordFrame;
+  if (!queued) {
+    g_recordDropped.fetch_add(1, std::memory_order_relaxed);
+    if (!g_recordFull)
+      error("Recorder queue full, dropping frames\n");
+    g_recordFull = true;
+    return;
+  }
+  g_recordFull = false;
+  // Frame is not visible to recorder until published
+  memcpy(g_recordFrames + (size_t)(g_recordQueued++ % RECORD_QUEUE) * size,
+         g_output[0], size);
+  g_recordQueue.publish();
+  sem_post(&g_recordWake);
+}
+
+void mergeUniverse(uint16_t buffer) {
+  /*  @brief  Merge source layers of a universe into its merged frame
+      @param  buffer Arena universe index
+      @note   HTP slots take maximum value of all sources. LTP slots take value
+     of source that last changed the slot.
+      @note   Processes 16 slots per iteration using vector max and select.
+  */
+
+  uint32_t sources = g_sourceMask[buffer];
+  for (uint16_t slot = 0; slot < DMX_SLOTS; slot += 16) {
+    v16u8 owner = *(v16u8 *)(g_owner[buffer] + slot);
+    v16u8 htp = {}, ltp = {};
+    for (uint32_t mask = sources; mask; mask &= mask - 1) {
+      uint8_t source = __builtin_ctz(mask);
+      v16u8 val = *(v16u8 *)(g_layer[source][buffer] + slot);
+      v16u8 greater = (v16u8)(val > htp);
+      htp = (val & greater) | (htp & ~greater);
+      v16u8 owned = (v16u8)(owner == source);
+      ltp = (val & owned) | (ltp & ~owned);
+    }
+    v16u8 isHtp = *(v16u8 *)(g_htp[buffer] + slot);
+    *(v16u8 *)(g_merged[buffer] + slot) = (htp & isHtp) | (ltp & ~isHtp);
+  }
+}
+
+void startFade(uint16_t buffer, uint16_t slot, uint8_t target) {
+  /*  @brief  Start fade of slot from its current level to a new value
+      @param  buffer Arena universe index
+      @param  slot DMX slot [0..511]
+      @param  target Value to fade to [0..255]
+      @note   Fade time is that of the last change to the slot
+  */
+
+  uint32_t ticks = (uint32_t)g_fadeTime[buffer][slot] * g_refreshRate / 1000;
+  int32_t end = target << 16;
+  g_fadeTarget[buffer][slot] = target;
+  if (ticks < 2) {
+    g_fadeLevel[buffer][slot] = end;
+    g_fadeTicks[buffer][slot] = 0;
+  } else {
+    g_fadeStep[buffer][slot] =
+        (end - g_fadeLevel[buffer][slot]) / (int32_t)ticks;
+    g_fadeTicks[buffer][slot] = ticks;
+  }
+}
+
+bool fadeUniverse(uint16_t buffer) {
+  /*  @brief  Advance fades of a universe by one refresh period
+      @param  buffer Arena universe index
+      @retval bool True if any slot is still fading
+      @note   Populates level frame from merged frame and fade levels
+      @note   Slots with no fade time take the merged value immediately
+  */
+
+  const uint8_t *merged = g_merged[buffer];
+  uint8_t *target = g_fadeTarget[buffer];
+  for (uint16_t slot = 0; slot < DMX_SLOTS; slot += 16) {
+    v16u8 changed =
+        (v16u8)(*(v16u8 *)(merged + slot) != *(v16u8 *)(target + slot));
+    uint64_t any[2];
+    memcpy(any, &changed, sizeof(any));
+    if (!(any[0] | any[1]))
+      continue;
+    for (uint16_t i = slot; i < slot + 16; ++i)
+      if (merged[i] != target[i])
+        startFade(buffer, i, merged[i]);
+  }
+
+  // Step all slots, 4 per iteration. Only slots with ticks remaining move.
+  v4i32 fading = {};
+  const v4i32 round = {0x8000, 0x8000, 0x8000, 0x8000};
+  int32_t *level = g_fadeLevel[buffer];
+  int32_t *step = g_fadeStep[buffer];
+  int32_t *ticks = g_fadeTicks[buffer];
+  uint8_t *output = g_level[buffer];
+  for (uint16_t slot = 0; slot < DMX_SLOTS; slot += 4) {
+    v4i32 active = *(v4i32 *)(ticks + slot) > 0;
+    v4i32 val = *(v4i32 *)(level + slot) + (*(v4i32 *)(step + slot) & active);
+    *(v4i32 *)(level + slot) = val;
+    *(v4i32 *)(ticks + slot) += active; // active is -1 (true) or 0
+    fading |= *(v4i32 *)(ticks + slot);
+    val = (val + round) >> 16;
+    for (uint8_t i = 0; i < 4; ++i)
+      output[slot + i] = val[i];
+  }
+  return fading[0] | fading[1] | fading[2] | fading[3];
+}
+
+void masterUniverse(uint16_t buffer) {
+  /*  @brief  Scale level frame of a universe by master levels
+      @param  buffer Arena universe index
+      @note   Multiplies 8 slots per iteration by their 16-bit scale then
+     shifts back to 8-bit
+  */
+
+  if (!(g_mastered[buffer / 64] & (1ULL << (buffer % 64))))
+    return;
+  uint8_t *level = g_level[buffer];
+  const uint16_t *scale = g_scale[buffer];
+  for (uint16_t slot = 0; slot < DMX_SLOTS; slot += 8) {
+    v8u16 val = __builtin_convertvector(*(v8u8 *)(level + slot), v8u16);
+    val = (val * *(v8u16 *)(scale + slot)) >> 8;
+    *(v8u8 *)(level + slot) = __builtin_convertvector(val, v8u8);
+  }
+}
+
+void curveUniverse(uint16_t buffer) {
+  /*  @brief  Apply response curves to a universe
+      @param  buffer Arena universe index
+      @note   Populates output frame from level frame
+      @note   Each slot indexes the lookup table of its curve. (There is no
+     portable SIMD gather, but 512 table reads per universe is cheap.)
+  */
+
+  if (!(g_curved[buffer / 64] & (1ULL << (buffer % 64)))) {
+    memcpy(g_output[buffer], g_level[buffer], DMX_SLOTS);
+    return;
+  }
+  const uint8_t *level = g_level[buffer];
+  const uint8_t *curve = g_curve[buffer];
+  uint8_t *output = g_output[buffer];
+  for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot)
+    output[slot] = g_curves[curve[slot]][level[slot]];
+}
+
+void onSignal(int signum) {
+  /*  @brief  Handle SIGHUP by requesting reload of response curves,
+     SIGUSR1 by requesting capture of selected scene and SIGINT / SIGTERM by
+     requesting exit
+      @param  signum Signal number
+  */
+
+  if (signum == SIGUSR1)
+    g_captureScene = true;
+  else if (signum == SIGHUP)
+    g_reloadCurves = true;
+  else
+    g_stop = true;
+}
+
+void reloadCurves() {
+  /*  @brief  Reload response curves if requested and resend affected universes
+      @note   Called from output thread
+  */
+
+  if (!g_reloadCurves.exchange(false))
+    return;
+  info("Reloading response curves\n");
+  loadCurves();
+  for (uint16_t buffer = 0; buffer < MAX_UNIVERSE; ++buffer)
+    if (g_sourceMask[buffer] &&
+        (g_curved[buffer / 64] & (1ULL << (buffer % 64))))
+      g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+}
+
+bool renderUniverse(uint16_t buffer) {
+  /*  @brief  Merge, fade, scale and curve a universe into its output frame
+      @param  buffer Arena universe index
+      @retval bool True if any slot is still fading
+      @note   Only touches frames of this universe so universes may be
+     rendered concurrently
+  */
+
+  if (g_dirty[buffer / 64] & (1ULL << (buffer % 64)))
+    mergeUniverse(buffer);
+  bool fading = fadeUniverse(buffer);
+  masterUniverse(buffer);
+  curveUniverse(buffer);
+  return fading;
+}
+
+void renderShare(uint8_t self) {
+  /*  @brief  Render own share of pending universes then steal from others
+      @param  self Index of worker
+      @note   Each universe is claimed by an atomic increment of the index of
+     next universe in a share, so owner and thieves never render one twice
+  */
+
+  for (uint8_t i = 0; i < g_threads; ++i) {
+    Worker *worker = &g_workers[(self + i) % g_threads];
+    uint32_t index;
+    while ((index = worker->next.fetch_add(1, std::memory_order_relaxed)) <
+           worker->end)
+      g_pendingFading[index] = renderUniverse(g_pending[index]);
+  }
+}
+
+void *renderThread(void *arg) {
+  /*  @brief  Render thread, renders a share of universes each period
+      @param  arg Index of worker
+  */
+
+  uint8_t self = (uintptr_t)arg;
+  while (true) {
+    pthread_barrier_wait(&g_renderStart);
+    if (g_renderStop)
+      break;
+    renderShare(self);
+    pthread_barrier_wait(&g_renderDone);
+  }
+  return NULL;
+}
+
+void startRenderThreads(uint8_t threads) {
+  /*  @brief  Start pool of render threads
+      @param  threads Quantity of render threads including output thread
+  */
+
+  g_threads = threads;
+  if (threads < 2)
+    return;
+  g_renderStop = false;
+  pthread_barrier_init(&g_renderStart, NULL, threads);
+  pthread_barrier_init(&g_renderDone, NULL, threads);
+  for (uint8_t i = 1; i < threads; ++i)
+    if (pthread_create(&g_workers[i].thread, NULL, renderThread,
+                       (void *)(uintptr_t)i)) {
+      error("Failed to start render thread\n");
+      exit(1);
+    }
+}
+
+void stopRenderThreads() {
+  // Stop and wait for render threads
+  if (g_threads < 2)
+    return;
+  g_renderStop = true;
+  pthread_barrier_wait(&g_renderStart);
+  for (uint8_t i = 1; i < g_threads; ++i)
+    pthread_join(g_workers[i].thread, NULL);
+  pthread_barrier_destroy(&g_renderStart);
+  pthread_barrier_destroy(&g_renderDone);
+  g_threads = 1;
+}
+
+void renderPending() {
+  /*  @brief  Render changed or fading universes, in parallel if configured
+      @note   Called from output thread, which renders as worker 0
+      @note   Each worker's share is a contiguous run of universes so it
+     mostly touches the same (cache local) frames each period
+  */
+
+  g_pendingCount = 0;
+  for (uint16_t word = 0; word < MAX_UNIVERSE / 64; ++word)
+    for (uint64_t pending = g_dirty[word] | g_fading[word]; pending;
+         pending &= pending - 1)
+      g_pending[g_pendingCount++] = word * 64 + __builtin_ctzll(pending);
+  uint32_t share = (g_pendingCount + g_threads - 1) / g_threads;
+  for (uint8_t i = 0; i < g_threads; ++i) {
+    uint32_t first = i * share;
+    g_workers[i].next.store(first < g_pendingCount ? first : g_pendingCount,
+                            std::memory_order_relaxed);
+    g_workers[i].end =
+        first + share < g_pendingCount ? first + share : g_pendingCount;
+  }
+  if (g_threads < 2) {
+    renderShare(0);
+    return;
+  }
+  pthread_barrier_wait(&g_renderStart);
+  renderShare(0);
+  pthread_barrier_wait(&g_renderDone);
+}
+
+void sendDirty() {
+  /*  @brief  Render and send changed or fading universes to OLA
+      @note   Called from output thread
+  */
+
+  renderPending();
+  for (uint16_t i = 0; i < g_pendingCount; ++i) {
+    uint16_t buffer = g_pending[i];
+    if (g_pendingFading[i])
+      g_fading[buffer / 64] |= 1ULL << (buffer % 64);
+    else
+      g_fading[buffer / 64] &= ~(1ULL << (buffer % 64));
+    if (g_freewheel)
+      continue; // Rendering faster than real time is not sent
+    g_dmxBuffer.Set(g_output[buffer], DMX_SLOTS);
+    g_olaClient->SendDmx(g_arenaBase + buffer, g_dmxBuffer);
+  }
+  memset(g_dirty, 0, sizeof(g_dirty));
+}
+
+void onDmxIn(const ola::client::DMXMetadata &metadata,
+             const ola::DmxBuffer &data) {
+  /*  @brief  Queue changed slots of DMX received from OLA for MIDI feedback
+      @param  metadata Universe of received DMX
+      @param  data Received DMX
+      @note   Called from OLA input thread
+      @note   Unchanged blocks of 16 slots are skipped with one vector compare
+      @note   A slot already queued is not queued again, so the queue holds
+     each slot at most once and the process thread sends its latest value
+  */
+
+  uint16_t buffer = metadata.universe - g_arenaBase;
+  if (metadata.universe < g_arenaBase || buffer >= MAX_UNIVERSE ||
+      g_feedbackPort[buffer] == 0xff)
+    return;
+  uint8_t portIndex = g_feedbackPort[buffer];
+  const MidiPort *port = &g_ports[portIndex];
+  uint8_t frame[DMX_SLOTS] __attribute__((aligned(16))) = {};
+  memcpy(frame, data.GetRaw(),
+         data.Size() < DMX_SLOTS ? data.Size() : DMX_SLOTS);
+  uint8_t msg[MAX_FEEDBACK_MESSAGES * 3];
+  for (uint16_t block = 0; block < DMX_SLOTS; block += 16) {
+    v16u8 changed = (v16u8)(*(v16u8 *)(frame + block) !=
+                            *(v16u8 *)(g_dmxIn[buffer] + block));
+    uint64_t any[2];
+    memcpy(any, &changed, sizeof(any));
+    if (!(any[0] | any[1]))
+      continue;
+    memcpy(g_dmxIn[buffer] + block, frame + block, 16);
+    for (uint16_t i = 0; i < 16; ++i) {
+      uint16_t slot = block + i;
+      if (!changed[i] || !feedbackMessages(port, buffer, &slot, msg) ||
+          g_feedbackQueued[buffer][slot].exchange(true,
+                                                  std::memory_order_acq_rel))
+        continue;
+      if (!g_feedbackQueue[portIndex].push((buffer << 9) | slot)) {
+        g_feedbackQueued[buffer][slot] = false;
+        g_feedbackOverflow.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  g_feedbackQueue[portIndex].publish();
+}
+
+void onDmxInRegister(const ola::client::Result &result) {
+  // Report failure to register for DMX input of a universe
+  if (!result.Success())
+    error("Failed to register for DMX input: %s\n", result.Error().c_str());
+}
+
+void *dmxInThread(void *args) {
+  /*  @brief  Run OLA client event loop, which receives DMX input
+      @param  args Pointer to OLA client wrapper
+  */
+
+  ((ola::client::OlaClientWrapper *)args)->GetSelectServer()->Run();
+  return NULL;
+}
+
+bool startDmxInput() {
+  /*  @brief  Register for DMX input of universes of ports with feedback and
+     start OLA input thread
+      @retval bool True on success
+      @note   A universe shared by ports with feedback is fed back by the first
+  */
+
+  static ola::client::OlaClientWrapper wrapper;
+  memset(g_feedbackPort, 0xff, sizeof(g_feedbackPort));
+  bool feedback = false;
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    const MidiPort *port = &g_ports[i];
+    if (!port->feedbackRate)
+      continue;
+    for (uint16_t buffer = port->bufferBase;
+         buffer < port->bufferBase + port->bufferCount; ++buffer)
+      if (g_feedbackPort[buffer] == 0xff)
+        g_feedbackPort[buffer] = i;
+    feedback = true;
+  }
+  if (!feedback)
+    return true;
+  if (!wrapper.Setup()) {
+    error("Failed to setup OLA client for DMX input\n");
+    return false;
+  }
+  ola::client::OlaClient *client = wrapper.GetClient();
+  client->SetDMXCallback(ola::NewCallback(&onDmxIn));
+  for (uint16_t buffer = 0; buffer < MAX_UNIVERSE; ++buffer)
+    if (g_feedbackPort[buffer] != 0xff)
+      client->RegisterUniverse(g_arenaBase + buffer, ola::client::REGISTER,
+                               ola::NewSingleCallback(&onDmxInRegister));
+  if (pthread_create(&g_dmxInThread, NULL, dmxInThread, &wrapper)) {
+    error("Failed to start DMX input thread\n");
+    return false;
+  }
+  g_dmxInServer = wrapper.GetSelectServer();
+  return true;
+}
+
+void stopDmxInput() {
+  // Stop OLA input thread
+  if (!g_dmxInServer)
+    return;
+  g_dmxInServer->Terminate();
+  pthread_join(g_dmxInThread, NULL);
+  g_dmxInServer = NULL;
+}
+
+bool waitTick(struct timespec *tick, long period) {
+  /*  @brief  Wait for next refresh period, or while freewheeling with a
+     recording, for JACK process thread to request next frame
+      @param  tick Time of last refresh period, advanced to this period
+      @param  period Refresh period in ns
+      @retval bool True if JACK process thread waits for this frame
+      @note   Called from output thread
+  */
+
+  static bool freewheeling = false;
+  while (g_freewheel && g_recordFrames && !g_stop) {
+    if (!freewheeling)
+      info("Freewheeling, rendering to %s\n", g_recordPath);
+    freewheeling = true;
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 100000000L;
+    if (timeout.tv_nsec >= 1000000000L) {
+      timeout.tv_nsec -= 1000000000L;
+      ++timeout.tv_sec;
+    }
+    if (!sem_timedwait(&g_freewheelTick, &timeout)) {
+      clock_gettime(CLOCK_MONOTONIC, tick);
+      return true;
+    }
+  }
+  if (freewheeling) {
+    // Resend universes, which were not sent while freewheeling
+    info("Freewheeling ended\n");
+    for (uint16_t buffer = 0; buffer < MAX_UNIVERSE; ++buffer)
+      g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+    freewheeling = false;
+  }
+  tick->tv_nsec += period;
+  if (tick->tv_nsec >= 1000000000L) {
+    tick->tv_nsec -= 1000000000L;
+    ++tick->tv_sec;
+  }
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, tick, NULL);
+  // Freewheeling may have ended after process thread requested a frame
+  return g_recordFrames && !sem_trywait(&g_freewheelTick);
+}
+
+void benchmark() {
+  /*  @brief  Show time to render each refresh period against quantity of
+     render threads and universes
+      @note   Every slot of every universe changes and starts a fade each
+     period, with masters and curves applied (worst case)
+  */
+
+  const uint16_t universes[] = {64, 256, 512};
+  const uint16_t periods = 200;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint8_t maxThreads = cpus > MAX_THREADS ? MAX_THREADS : cpus;
+  if (g_threads > maxThreads)
+    maxThreads = g_threads;
+  for (uint16_t buffer = 0; buffer < MAX_UNIVERSE; ++buffer) {
+    g_sourceMask[buffer] = 1 | (1UL << EFFECT_SOURCE);
+    memset(g_htp[buffer], 0xff, DMX_SLOTS);
+    for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot) {
+      g_fadeTime[buffer][slot] = 1000;
+      g_scale[buffer][slot] = 256;
+    }
+  }
+  memset(g_mastered, 0xff, sizeof(g_mastered));
+  memset(g_curved, 0xff, sizeof(g_curved));
+  info("Render time per refresh period (%u Hz period is %uus)\n",
+       g_refreshRate, 1000000 / g_refreshRate);
+  for (uint8_t threads = 1; threads <= maxThreads;
+       threads = threads * 2 > maxThreads && threads < maxThreads
+                     ? maxThreads
+                     : threads * 2) {
+    startRenderThreads(threads);
+    for (uint16_t count : universes) {
+      double total = 0;
+      for (uint16_t period = 0; period < periods; ++period) {
+        for (uint16_t buffer = 0; buffer < count; ++buffer)
+          for (uint16_t slot = 0; slot < DMX_SLOTS; ++slot) {
+            g_layer[0][buffer][slot] = slot + period * 7;
+            g_layer[EFFECT_SOURCE][buffer][slot] = buffer - period * 5;
+          }
+        memset(g_dirty, 0, sizeof(g_dirty));
+        for (uint16_t buffer = 0; buffer < count; ++buffer)
+          g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        renderPending();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total += (end.tv_sec - start.tv_sec) * 1e6 +
+                 (end.tv_nsec - start.tv_nsec) / 1e3;
+      }
+      info("  %3u universes %2u threads: %8.1fus\n", count, threads,
+           total / periods);
+    }
+    stopRenderThreads();
+  }
+  memset(g_dirty, 0, sizeof(g_dirty));
+}
+
+int main(int argc, char *argv[]) {
+  strcpy(g_jackname, "jackmidiola");
+  parseCommandLine(argc, argv);
+  if (!g_enableNote && !g_enableCC)
+    g_enableCC = true;
+  configurePorts();
+  configureDecoders();
+  if (!loadCurves() || !loadCues() || !loadScenes() || !loadShow())
+    exit(1);
+  if (g_benchmark) {
+    benchmark();
+    return 0;
+  }
+
+  info("Starting jackmidiola - JACK MIDI to Openlighting interface\n");
+  info("  Refresh rate: %u Hz\n", g_refreshRate);
+  if (g_threads > 1)
+    info("  Render threads: %u\n", g_threads);
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    MidiPort *port = &g_ports[i];
+    info("  Port: %s\n", port->name);
+    for (uint8_t mode = 0; mode < MIDI_MODE_COUNT; ++mode) {
+      uint16_t channels = 0;
+      for (uint8_t chan = 0; chan < 16; ++chan)
+        if (port->mode[chan] == mode)
+          channels |= 1 << chan;
+      if (channels) {
+        info("    Mode %s on MIDI channels: ", modeNames[mode]);
+        infoChannels(channels);
+      }
+    }
+    info("    Universes: %u..%u\n", port->universeBase,
+         port->universeBase + port->bufferCount - 1);
+    info("    Enabled MIDI channels: ");
+    infoChannels(port->midiChannels);
+    if (port->fadeTime)
+      info("    Fade time: %ums\n", port->fadeTime);
+    if (port->fadeCC != 0xff)
+      info("    Fade time CC: %u\n", port->fadeCC);
+    for (uint8_t master = 0; master < MAX_MASTERS; ++master)
+      if (port->masterCC[master] != 0xffff)
+        info("    %s %u: MIDI channel %u CC %u\n",
+             master ? "Submaster" : "Grand master", master,
+             (port->masterCC[master] >> 8) + 1, port->masterCC[master] & 0x7f);
+    for (uint8_t group = 0; group < MAX_GROUPS; ++group)
+      if (port->groupCC[group] != 0xffff)
+        info("    Group %u (%u slots): MIDI channel %u CC %u\n", group + 1,
+             g_groupStart[group + 1] - g_groupStart[group],
+             (port->groupCC[group] >> 8) + 1, port->groupCC[group] & 0x7f);
+    if (g_clockPort == i)
+      info("    Following MIDI clock\n");
+    if (g_mtcPort == i)
+      info("    Following MIDI Time Code\n");
+    if (port->feedbackRate)
+      info("    Feedback of DMX input: up to %u MIDI messages/s\n",
+           port->feedbackRate);
+    if (port->dump)
+      info("    Reply to SysEx dump requests\n");
+    if (port->nrpnIncrement)
+      info("    NRPN data entry advances to next slot\n");
+    for (uint8_t chan = 0; chan < 16; ++chan)
+      for (uint8_t cc = 0; cc < 128; ++cc)
+        if (port->ccFunction[chan][cc] >> 8 == CC_FUNC_ENCODER)
+          info("    Encoder: MIDI channel %u CC %u (%s)\n", chan + 1, cc,
+               encoderModes[port->ccFunction[chan][cc] & 0xff]);
+    if (port->cueGo != 0xffff)
+      info("    Cue GO: MIDI channel %u note %u\n", (port->cueGo >> 8) + 1,
+           port->cueGo & 0x7f);
+    if (port->cueBack != 0xffff)
+      info("    Cue BACK: MIDI channel %u note %u\n", (port->cueBack >> 8) + 1,
+           port->cueBack & 0x7f);
+    if (port->sceneChannel != 0xff)
+      info("    Scene program change: MIDI channel %u\n",
+           port->sceneChannel + 1);
+    if (port->captureNote != 0xff)
+      info("    Scene capture: MIDI channel %u note %u\n",
+           port->sceneChannel + 1, port->captureNote);
+    if (port->cueChannel != 0xff)
+      info("    Cue program change: MIDI channel %u\n", port->cueChannel + 1);
+    for (uint8_t effect = 0; effect < MAX_EFFECTS; ++effect) {
+      if (port->effectNote[effect] != 0xffff)
+        info("    Effect %u: MIDI channel %u note %u\n", effect + 1,
+             (port->effectNote[effect] >> 8) + 1,
+             port->effectNote[effect] & 0x7f);
+      if (port->effectCC[effect] != 0xffff)
+        info("    Effect %u level: MIDI channel %u CC %u\n", effect + 1,
+             (port->effectCC[effect] >> 8) + 1, port->effectCC[effect] & 0x7f);
+      if (port->rateCC[effect] != 0xffff)
+        info("    Effect %u rate: MIDI channel %u CC %u\n", effect + 1,
+             (port->rateCC[effect] >> 8) + 1, port->rateCC[effect] & 0x7f);
+    }
+    if (port->noteFade)
+      info("    Note-on fades to full over velocity x 100ms\n");
+    for (uint8_t chan = 0; chan < 16; ++chan)
+      if (port->bend[chan].enabled)
+        info("    Pitch bend on MIDI channel %u: universe %u slot %u%s\n",
+             chan + 1, port->bend[chan].universe, port->bend[chan].slot + 1,
+             port->bend[chan].wide ? " (16-bit)" : "");
+    for (uint8_t chan = 0; chan < 16; ++chan)
+      if (port->pressure[chan].enabled)
+        info("    Pressure on MIDI channel %u: universe %u slot %u%s\n",
+             chan + 1, port->pressure[chan].universe,
+             port->pressure[chan].slot + 1,
+             port->pressure[chan].wide ? " (16-bit)" : "");
+  }
+  for (uint16_t i = 0; i < g_curveRangeCount; ++i) {
+    const CurveRange *curveRange = &g_curveRanges[i];
+    const Curve *curve = &g_curveDefs[curveRange->curve];
+    const char *names[] = {"linear", "gamma", "scurve", "invert", "file"};
+    info("  Curve universe %u slots %u..%u: %s", curveRange->range.universe,
+         curveRange->range.first + 1, curveRange->range.last + 1,
+         names[curve->type]);
+    if (curve->type == CURVE_GAMMA)
+      info(" %.2f", curve->gamma);
+    else if (curve->type == CURVE_FILE)
+      info(" %s", curve->path);
+    info("\n");
+  }
+  for (uint8_t i = 0; i < MAX_EFFECTS; ++i) {
+    const Effect *effect = &g_effects[i];
+    if (effect->beats)
+      info("  Effect %u: %s on group %u, period %.2f beats, spread %.2f\n",
+           i + 1, effectShapes[effect->shape], effect->group + 1,
+           effect->beats, effect->spread);
+    else if (effect->period)
+      info("  Effect %u: %s on group %u, period %ums, spread %.2f\n", i + 1,
+           effectShapes[effect->shape], effect->group + 1, effect->period,
+           effect->spread);
+  }
+  if (g_show)
+    info("  Show: %s, %u frames at %u fps of universes %u..%u%s\n",
+         g_showPath, g_showHeader.frames, g_showHeader.rate,
+         g_showHeader.universe,
+         g_showHeader.universe + g_showHeader.universes - 1,
+         g_transport ? " following JACK transport" : "");
+  if (g_sceneBank)
+    info("  Scenes: %u of universes %u..%u in %s\n", g_sceneBank->scenes,
+         g_sceneBank->universe,
+         g_sceneBank->universe + g_sceneBank->universes - 1, g_scenePath);
+  if (g_cueCount)
+    info("  Cues: %u from %s (%u slot changes)\n", g_cueCount, g_cuePath,
+         g_cueChangeCount / 2);
+  debug("  Debug enabled\n");
+
+  // Create a OLA client.
+  ola::client::StreamingClient olaClient(
+      (ola::client::StreamingClient::Options()));
+  g_olaClient = &olaClient;
+
+  // Setup OLA, connect to the server
+  if (!olaClient.Setup()) {
+    error("Failed to setup OLA client. Is olad running?\n");
+    exit(1);
+  }
+  // Send blackout to first universe of each port
+  debug("Initalising DMX buffers\n");
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    uint16_t buffer = g_ports[i].bufferBase;
+    g_dirty[buffer / 64] |= 1ULL << (buffer % 64);
+  }
+  sendDirty();
+
+  // Create JACK client
+  char *serverName = NULL;
+  jack_status_t jackStatus;
+  if ((g_jackClient = jack_client_open(g_jackname, JackNoStartServer,
+                                       &jackStatus, serverName)) == 0) {
+    error("Failed to start jack client: %d. Is jackd running?\n", jackStatus);
+    exit(1);
+  }
+  // Create MIDI input ports
+  for (uint8_t i = 0; i < g_portCount; ++i) {
+    if (!(g_ports[i].jackPort = jack_port_register(
+              g_jackClient, g_ports[i].name, JACK_DEFAULT_MIDI_TYPE,
+              JackPortIsInput | JackPortIsPhysical, 0))) {
+      error("Cannot register jack input port %s\n", g_ports[i].name);
+      exit(1);
+    }
+    if (!g_ports[i].feedbackRate && !g_ports[i].dump)
+      continue;
+    char name[sizeof(g_ports[i].name) + 4];
+    snprintf(name, sizeof(name), "%s_out", g_ports[i].name);
+    if (!(g_ports[i].outputPort = jack_port_register(
+              g_jackClient, name, JACK_DEFAULT_MIDI_TYPE,
+              JackPortIsOutput | JackPortIsPhysical, 0))) {
+      error("Cannot register jack output port %s\n", name);
+      exit(1);
+    }
+  }
+  signal(SIGHUP, onSignal);
+  signal(SIGUSR1, onSignal);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
   // Register JACK callbacks
   jack_set_process_callback(g_jackClient, onJackProcess, 0);
+  jack_set_latency_callback(g_jackClient, onJackLatency, 0);
+  jack_set_freewheel_callback(g_jackClient, onJackFreewheel, 0);
   if (jack_activate(g_jackClient)) {
     error("Cannot activate jack client\n");
     exit(1);
@@ -512,10 +4651,31 @@ int main(int argc, char *argv[]) {
     info("Listening for MIDI Note-On\n");
   if (g_enableNoteOff)
     info("Listening for MIDI Note-Off\n");
+  if (g_enablePolyPressure)
+    info("Listening for MIDI Polyphonic Aftertouch\n");
 
-  while (true) {
-    usleep(25000); // Do nothing in program loop
+  // Output loop - apply queued changes and send to OLA each refresh period
+  startRenderThreads(g_threads);
+  if (!startRecorder() || !startDmxInput())
+    exit(1);
+  struct timespec tick;
+  clock_gettime(CLOCK_MONOTONIC, &tick);
+  const long period = 1000000000L / g_refreshRate;
+  while (!g_stop) {
+    bool frame = waitTick(&tick, period);
+    updateLatency();
+    processEvents();
+    reloadCurves();
+    playShow();
+    renderEffects();
+    sendDirty();
+    recordFrame();
+    if (frame)
+      sem_post(&g_freewheelDone);
   }
 
+  stopDmxInput();
+  stopRecorder();
+  stopRenderThreads();
   return 0;
 }